@@ -5,6 +5,7 @@
 #include <QGraphicsItem>
 #include <QGraphicsGridLayout>
 #include "CameraOutput.h"
+#include "DisplayGovernor.h"
 #include <QVector>
 
 #include <QDebug>
@@ -14,7 +15,8 @@ class CameraOutputGrid : public QGraphicsWidget
 public:
     explicit CameraOutputGrid(QGraphicsItem* parent = nullptr):
         QGraphicsWidget(parent),
-        m_layout(new QGraphicsGridLayout(this))
+        m_layout(new QGraphicsGridLayout(this)),
+        m_governor(new DisplayGovernor(this))
     {
         setLayout(m_layout);
         int numChannels = 4;
@@ -29,19 +31,79 @@ public:
         //        }
 
         CameraOutput* channelOutput = new CameraOutput(this);
+        m_outputs.append(channelOutput);
+        m_governor->addChannel(channelOutput->imageItem());
 
         //qDebug()<<row << "," << col;
         m_layout->addItem(channelOutput, 0, 0,1,1);
 
+        m_governor->start();
+
 
 
     }
     ~CameraOutputGrid()
     {
+        m_governor->stop();
         qDeleteAll(m_outputs);
     }
+
+    // Converts the selected channel's frames first, and keeps its display
+    // rate up longest when the GUI thread falls behind; -1 selects none.
+    void setSelectedChannel(int channel)
+    {
+        m_governor->setFocusedChannel(channel);
+        for (int i = 0; i < m_outputs.size(); ++i) {
+            m_outputs[i]->setConversionPriority(
+                i == channel ? core::ConversionPool::Priority::high
+                             : core::ConversionPool::Priority::normal);
+        }
+    }
+
+    int channelCount() const
+    {
+        return m_outputs.size();
+    }
+
+    // See CameraOutput::setTiled().
+    void setTiled(int channel, bool tiled)
+    {
+        if (channel >= 0 && channel < m_outputs.size()) {
+            m_outputs[channel]->setTiled(tiled);
+        }
+    }
+
+    bool isTiled(int channel) const
+    {
+        return channel >= 0 && channel < m_outputs.size() &&
+               m_outputs[channel]->isTiled();
+    }
+
+    // See CameraOutput::setDemosaic().
+    void setDemosaic(int channel, core::Image::Demosaic demosaic)
+    {
+        if (channel >= 0 && channel < m_outputs.size()) {
+            m_outputs[channel]->setDemosaic(demosaic);
+        }
+    }
+
+    core::Image::Demosaic demosaic(int channel) const
+    {
+        return channel >= 0 && channel < m_outputs.size()
+                       ? m_outputs[channel]->demosaic()
+                       : core::Image::Demosaic::bilinear;
+    }
+
+    // Performance figures over every channel, see PerformanceHud.
+    void setHudVisible(bool visible)
+    {
+        for (CameraOutput* output : m_outputs) {
+            output->setHudVisible(visible);
+        }
+    }
 private:
     QGraphicsGridLayout* m_layout;
+    DisplayGovernor* m_governor;
     QVector<CameraOutput*> m_outputs;
 };
 
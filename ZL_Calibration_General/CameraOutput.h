@@ -8,6 +8,8 @@
 #include <QGraphicsScene>
 #include <QLabel>
 #include "Image_base.h"
+#include "PerformanceHud.h"
+#include "TiledImageItem.h"
 
 class CameraOutput : public QGraphicsWidget {
     Q_OBJECT
@@ -19,14 +21,146 @@ public:
         qDebug()<<"CameraOutput";
 //        QLabel *label = new QLabel("CH 1");
 //        m_layout->addItem(label);
-        ImageItemBase *imageItem = new ImageItem(this);
-        m_layout->addItem(imageItem);
+        m_imageItem = new ImageItem(this);
+        m_layout->addItem(m_imageItem);
 
         setLayout(m_layout);//设置布局
 
     }
+
+    ImageItem* imageItem() const {
+        return m_imageItem;
+    }
+
+    // This channel's frames, to whichever item shows them.
+    void setImage(const core::Image& image) {
+        if (m_tiledItem) {
+            m_tiledItem->setImage(image);
+        } else {
+            m_imageItem->setImage(image);
+        }
+    }
+
+    void setPreviewBinning(int binning) {
+        m_imageItem->setPreviewBinning(binning);
+    }
+
+    // Demosaic quality of this channel's frames, see ImageConverter.
+    void setDemosaic(core::Image::Demosaic demosaic) {
+        m_demosaic = demosaic;
+        m_imageItem->setDemosaic(demosaic);
+        m_tileOptions.demosaic = demosaic;
+        if (m_tiledItem) {
+            m_tiledItem->setConversionOptions(m_tileOptions);
+        }
+    }
+
+    core::Image::Demosaic demosaic() const {
+        return m_demosaic;
+    }
+
+    // Shows this channel through a TiledImageItem, converting only the
+    // tiles on screen, for sensors far larger than a view zoomed into them.
+    // The last frame carries over either way.
+    void setTiled(bool tiled) {
+        if (tiled == isTiled()) {
+            return;
+        }
+        if (tiled) {
+            m_tiledItem = new TiledImageItem(this);
+            m_tiledItem->setConversionOptions(m_tileOptions);
+            m_tiledItem->setImage(m_imageItem->image());
+            m_layout->removeItem(m_imageItem);
+            m_imageItem->hide();
+            m_layout->addItem(m_tiledItem);
+        } else {
+            m_imageItem->setImage(m_tiledItem->image());
+            m_layout->removeItem(m_tiledItem);
+            delete m_tiledItem;
+            m_tiledItem = nullptr;
+            m_imageItem->show();
+            m_layout->addItem(m_imageItem);
+        }
+        if (m_hud) {
+            m_hud->setItem(shownItem());
+        }
+    }
+
+    bool isTiled() const {
+        return m_tiledItem != nullptr;
+    }
+
+    // The item showing this channel's frames, tiled or not.
+    ImageItemBase* shownItem() const {
+        if (m_tiledItem) {
+            return m_tiledItem;
+        }
+        return m_imageItem;
+    }
+
+    // Options of tile conversions, fitTo aside; see TiledImageItem.
+    void setTileConversionOptions(
+            const core::Image::ConversionOptions& options) {
+        m_tileOptions = options;
+        if (m_tiledItem) {
+            m_tiledItem->setConversionOptions(options);
+        }
+    }
+
+    // Conversions per second of this channel, 0 for every frame.
+    void setMaxDisplayRate(double rate) {
+        m_imageItem->setMaxDisplayRate(rate);
+    }
+
+    // High while this channel is selected, see core::ConversionPool.
+    void setConversionPriority(core::ConversionPool::Priority priority) {
+        m_imageItem->setConversionPriority(priority);
+    }
+
+    // See ImageItem::setZoomable().
+    void setZoomable(bool zoomable) {
+        m_imageItem->setZoomable(zoomable);
+    }
+
+    // See ImageItem::PaintMode.
+    void setPaintMode(ImageItem::PaintMode mode) {
+        m_imageItem->setPaintMode(mode);
+    }
+
+    // Tone mapping of this channel's frames, see ImageConverter. Tiles share
+    // one lookup table, built here and only when the mapping changed.
+    void setToneMapping(
+            const std::optional<core::Image::ToneMapping>& mapping) {
+        m_imageItem->setToneMapping(mapping);
+        auto& lut = m_tileOptions.toneLut;
+        if (!mapping) {
+            lut = nullptr;
+        } else if (!lut || lut->mapping() != *mapping) {
+            lut = std::make_shared<const core::ToneLut>(*mapping);
+        }
+        if (m_tiledItem) {
+            m_tiledItem->setConversionOptions(m_tileOptions);
+        }
+    }
+
+    // Draws this channel's frame rates and timings over it, see
+    // PerformanceHud.
+    void setHudVisible(bool visible) {
+        if (visible && !m_hud) {
+            m_hud = new PerformanceHud(shownItem(), this);
+        } else if (!visible && m_hud) {
+            delete m_hud;
+            m_hud = nullptr;
+        }
+    }
 private:
     QGraphicsLinearLayout* m_layout;
+    ImageItem* m_imageItem;
+    // while tiled, in place of m_imageItem
+    TiledImageItem* m_tiledItem = nullptr;
+    core::Image::ConversionOptions m_tileOptions;
+    core::Image::Demosaic m_demosaic = core::Image::Demosaic::bilinear;
+    PerformanceHud* m_hud = nullptr;
 
 };
 
@@ -10,6 +10,12 @@
 #include <QStandardItemModel>
 #include <QSplitter>
 #include <QMessageBox>
+#include <QAction>
+#include <QActionGroup>
+#include <QMenu>
+#include <QWheelEvent>
+
+#include <cmath>
 
 #include "CameraControllerView.h"
 class ChannelViewerWidget:public QWidget{
@@ -35,6 +41,19 @@ public:
         setupTreeView();
         graphicsView->setScene(graphicsScene);
 
+        // off by default, cheap enough to leave on during a calibration run
+        QAction* hudAction = new QAction(tr("Performance overlay"), this);
+        hudAction->setCheckable(true);
+        connect(hudAction, &QAction::toggled, m_outputGrid,
+                &CameraOutputGrid::setHudVisible);
+        graphicsView->addAction(hudAction);
+        graphicsView->setContextMenuPolicy(Qt::ActionsContextMenu);
+
+        // Ctrl+wheel zooms, for tiled and zoomable channels
+        graphicsView->setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+        graphicsView->setDragMode(QGraphicsView::ScrollHandDrag);
+        graphicsView->viewport()->installEventFilter(this);
+
 
         layout->addWidget(treeView,1);
         layout->addWidget(graphicsView,5);
@@ -49,9 +68,71 @@ public:
 
 
     }
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override
+    {
+        if (watched == graphicsView->viewport() &&
+            event->type() == QEvent::Wheel) {
+            auto* wheel = static_cast<QWheelEvent*>(event);
+            if (wheel->modifiers() & Qt::ControlModifier) {
+                const qreal factor =
+                        std::pow(1.25, wheel->angleDelta().y() / 120.0);
+                graphicsView->scale(factor, factor);
+                return true;
+            }
+        }
+        return QWidget::eventFilter(watched, event);
+    }
+
 private slots:
+    // Per channel display settings, for the channel under the cursor.
+    void showChannelMenu(const QPoint& pos)
+    {
+        const QModelIndex index = treeView->indexAt(pos);
+        const int channel = index.isValid() ? index.row() : -1;
+        if (channel < 0 || channel >= m_outputGrid->channelCount()) {
+            return;
+        }
+
+        QMenu menu(this);
+        QAction* tiled = menu.addAction(tr("Tiled deep zoom"));
+        tiled->setCheckable(true);
+        tiled->setChecked(m_outputGrid->isTiled(channel));
+        connect(tiled, &QAction::toggled, this, [this, channel](bool on) {
+            m_outputGrid->setTiled(channel, on);
+        });
+
+        using Demosaic = core::Image::Demosaic;
+        const struct {
+            const char* text;
+            Demosaic demosaic;
+        } tiers[] = {
+            {QT_TR_NOOP("Nearest (fastest)"), Demosaic::nearest},
+            {QT_TR_NOOP("Bilinear"), Demosaic::bilinear},
+            {QT_TR_NOOP("Edge-aware (measurements)"), Demosaic::edgeAware},
+        };
+        QMenu* demosaicMenu = menu.addMenu(tr("Demosaic"));
+        QActionGroup* demosaicGroup = new QActionGroup(demosaicMenu);
+        for (const auto& tier : tiers) {
+            QAction* action = demosaicMenu->addAction(tr(tier.text));
+            action->setCheckable(true);
+            action->setChecked(m_outputGrid->demosaic(channel) ==
+                               tier.demosaic);
+            demosaicGroup->addAction(action);
+            const Demosaic demosaic = tier.demosaic;
+            connect(action, &QAction::triggered, this,
+                    [this, channel, demosaic] {
+                m_outputGrid->setDemosaic(channel, demosaic);
+            });
+        }
+        menu.exec(treeView->viewport()->mapToGlobal(pos));
+    }
+
     void handleTreeViewSelection(const QModelIndex& current)
     {
+        m_outputGrid->setSelectedChannel(current.isValid() ? current.row()
+                                                           : -1);
+
 //        // Calculate preferred height for the text item
 //        int textHeight = 20; // Adjust as needed
 
@@ -93,5 +174,9 @@ private:
 
         connect(treeView->selectionModel(), &QItemSelectionModel::currentChanged,
                 this, &ChannelViewerWidget::handleTreeViewSelection);
+
+        treeView->setContextMenuPolicy(Qt::CustomContextMenu);
+        connect(treeView, &QTreeView::customContextMenuRequested, this,
+                &ChannelViewerWidget::showChannelMenu);
     }
 };
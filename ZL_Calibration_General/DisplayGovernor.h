@@ -0,0 +1,232 @@
+#ifndef DISPLAYGOVERNOR_H
+#define DISPLAYGOVERNOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include "Image_base.h"
+
+// Lowers the display rate of channels while the GUI thread falls behind, and
+// raises it back once it keeps up. Every tick it measures how late its own
+// timer fired, the lag of the GUI thread's event queue, and the share of the
+// thread spent delivering and painting frames (ImageItem::PaintStatistics).
+// Over either limit it lowers the costliest unfocused channel, the focused
+// one only when all others are at the minimum; with headroom it raises the
+// focused channel first.
+//
+// Channels start uncapped and are only capped once the GUI thread falls
+// behind, at a quarter below the rate they were shown at; raised back to
+// maxRate they are uncapped again. Ticks in which no channel received a
+// frame change nothing, so an idle view keeps its rates.
+//
+// Only display conversion is throttled: frames still reach every item, and
+// acquisition and recording never see the governor.
+class DisplayGovernor : public QObject {
+    Q_OBJECT
+
+public:
+    struct Limits {
+        // the display's refresh rate, the highest rate a channel is capped
+        // at; raised past it, a channel is uncapped
+        double maxRate{60};
+        double minRate{2};
+        // event queue lag above which rates go down
+        qint64 maxLagNanoseconds{20'000'000};
+        // share of the GUI thread frames may take
+        double maxPaintShare{0.5};
+    };
+
+    static constexpr int tickMilliseconds = 250;
+
+    explicit DisplayGovernor(QObject* parent = nullptr) :
+        QObject(parent), m_timer(this) {
+        m_timer.setTimerType(Qt::PreciseTimer);
+        m_timer.setInterval(tickMilliseconds);
+        m_timer.callOnTimeout(this, &DisplayGovernor::tick);
+    }
+
+    void setLimits(const Limits& limits) {
+        m_limits = limits;
+        for (auto& channel : m_channels) {
+            setRate(channel, channel.rate, channel.reason);
+        }
+    }
+
+    // The item keeps its current rate, uncapped unless set otherwise.
+    void addChannel(ImageItem* item) {
+        Channel channel;
+        channel.item = item;
+        channel.last = item->paintStatistics();
+        channel.received = item->receivedFrames();
+        channel.rate = item->displayRate();
+        channel.reason = item->displayRateReason();
+        m_channels.append(channel);
+    }
+
+    // The channel given preference, -1 for none.
+    void setFocusedChannel(int channel) {
+        m_focused = channel;
+    }
+
+    void start() {
+        m_clock.start();
+        m_lastTick = 0;
+        m_timer.start();
+    }
+
+    void stop() {
+        m_timer.stop();
+    }
+
+    // 0 while uncapped.
+    double rate(int channel) const {
+        return m_channels[channel].rate;
+    }
+
+    // Why the channel is capped, empty when it is not.
+    QString reason(int channel) const {
+        return m_channels[channel].reason;
+    }
+
+Q_SIGNALS:
+    void rateChanged(int channel, double rate, const QString& reason);
+
+private:
+    struct Channel {
+        ImageItem* item{nullptr};
+        ImageItem::PaintStatistics last;
+        quint64 received{0};
+        // GUI thread nanoseconds per second for this channel's frames
+        double load{0};
+        // frames per second delivered over the last tick
+        double shown{0};
+        // 0 for uncapped
+        double rate{0};
+        QString reason;
+    };
+
+    // A rate of 0 uncaps the channel, others are kept within the limits.
+    void setRate(Channel& channel, double rate, const QString& reason) {
+        if (rate > 0) {
+            rate = std::clamp(rate, m_limits.minRate, m_limits.maxRate);
+        }
+        if (rate == channel.rate && reason == channel.reason) {
+            return;
+        }
+        channel.rate = rate;
+        channel.reason = reason;
+        channel.item->setMaxDisplayRate(rate, reason);
+        Q_EMIT rateChanged(int(&channel - m_channels.data()), rate, reason);
+    }
+
+    void tick() {
+        const qint64 now = m_clock.nsecsElapsed();
+        const qint64 elapsed = now - m_lastTick;
+        m_lastTick = now;
+        if (elapsed <= 0) {
+            return;
+        }
+        // late firing is time the event queue spent on other work
+        const qint64 lag = (std::max)(
+                elapsed - qint64(tickMilliseconds) * 1'000'000, qint64(0));
+        m_lag = (m_lag * 3 + lag) / 4;
+
+        double share = 0;
+        bool receiving = false;
+        for (auto& channel : m_channels) {
+            const auto s = channel.item->paintStatistics();
+            const qint64 spent =
+                    s.deliverNanoseconds - channel.last.deliverNanoseconds +
+                    s.paintNanoseconds - channel.last.paintNanoseconds;
+            channel.load = double(spent) / elapsed;
+            channel.shown = (s.frames - channel.last.frames) * 1e9 / elapsed;
+            channel.last = s;
+            share += channel.load;
+
+            const quint64 received = channel.item->receivedFrames();
+            receiving = receiving || received != channel.received;
+            channel.received = received;
+        }
+        if (!receiving) {
+            return;
+        }
+
+        if (m_lag > m_limits.maxLagNanoseconds) {
+            lower(QString("event lag %1 ms").arg(m_lag / 1e6, 0, 'f', 0));
+        } else if (share > m_limits.maxPaintShare) {
+            lower(QString("painting %1% of GUI thread")
+                          .arg(share * 100, 0, 'f', 0));
+        } else if (m_lag < m_limits.maxLagNanoseconds / 2 &&
+                   share < m_limits.maxPaintShare * 0.7) {
+            raise();
+        }
+    }
+
+    bool isFocused(const Channel& channel) const {
+        return int(&channel - m_channels.data()) == m_focused;
+    }
+
+    // By a quarter, the unfocused channel costing the GUI thread the most
+    // first. An uncapped channel is capped a quarter below the rate it was
+    // shown at, or below maxRate if faster. Only channels that cost
+    // something and, uncapped, showed frames are capped; with none of
+    // them nothing is.
+    void lower(const QString& reason) {
+        Channel* costliest = nullptr;
+        for (bool focused : {false, true}) {
+            for (auto& channel : m_channels) {
+                const bool lowerable =
+                        channel.load > 0 &&
+                        (channel.rate == 0 ? channel.shown > 0
+                                           : channel.rate > m_limits.minRate);
+                if (isFocused(channel) == focused && lowerable &&
+                    (!costliest || channel.load > costliest->load)) {
+                    costliest = &channel;
+                }
+            }
+            if (costliest) {
+                Channel& channel = *costliest;
+                const double from =
+                        channel.rate > 0
+                                ? channel.rate
+                                : (std::min)(channel.shown, m_limits.maxRate);
+                setRate(channel, (std::max)(from * 0.75, m_limits.minRate),
+                        reason);
+                return;
+            }
+        }
+    }
+
+    // By a quarter plus one, the focused channel first, uncapping it once
+    // it reaches maxRate; one channel per tick, so a rise that overloads is
+    // caught before the next.
+    void raise() {
+        for (bool focused : {true, false}) {
+            for (auto& channel : m_channels) {
+                if (isFocused(channel) == focused && channel.rate > 0) {
+                    const double rate = channel.rate * 1.25 + 1;
+                    if (rate < m_limits.maxRate) {
+                        setRate(channel, rate, channel.reason);
+                    } else {
+                        setRate(channel, 0, QString());
+                    }
+                    return;
+                }
+            }
+        }
+    }
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_lastTick = 0;
+    // smoothed, nanoseconds
+    qint64 m_lag = 0;
+    Limits m_limits;
+    QVector<Channel> m_channels;
+    int m_focused = -1;
+};
+
+#endif // DISPLAYGOVERNOR_H
@@ -2,72 +2,364 @@
 #define IMAGEITEM_H
 #include <QObject>
 #include <QTimer>
+#include <atomic>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <utility>
 #include <QImage>
+#include <conversion_pool.hpp>
 #include <image.h>
+#include <image_pyramid.hpp>
+#include <image_tone.hpp>
+#include <latency_histogram.hpp>
+#include <trace.hpp>
+#include <triple_buffer.hpp>
+// Converts one channel's frames for painting on the shared ConversionPool.
+// Lives on the thread delivering frames. A frame arriving queues one task;
+// nothing runs between frames. Frames arriving while one is still waiting
+// replace it, so the newest is always converted next; they are handed over
+// through a lock-free triple buffer, so the thread delivering them never
+// waits on a conversion.
 class ImageConverter : public QObject {
     Q_OBJECT
 
 public:
-    ImageConverter() : m_timer(this) {
+    using Priority = core::ConversionPool::Priority;
+
+    explicit ImageConverter(
+            QObject* parent = nullptr,
+            core::ConversionPool& pool = core::ConversionPool::instance()) :
+            QObject(parent), m_timer(this), m_pool(pool) {
         m_timer.setTimerType(Qt::PreciseTimer);
-        m_timer.setInterval(1000 / 60);
-        m_timer.callOnTimeout(this, &ImageConverter::convert);
+        m_timer.setSingleShot(true);
+        m_timer.callOnTimeout(this, &ImageConverter::submit);
     }
 
+    // Waits for a conversion still running on the pool.
     ~ImageConverter() {
         stop();
+        m_pool.cancel(this);
     }
 
     bool isStart() const {
-        return m_timer.isActive();
+        return m_running;
+    }
+
+    // Frames replaced by a newer one before they were converted.
+    quint64 skippedFrames() const noexcept {
+        return m_frames.skipped();
+    }
+
+    // Frames requested since construction, converted or not.
+    quint64 receivedFrames() const noexcept {
+        return m_received.load(std::memory_order_relaxed);
+    }
+
+    // Time from taking a frame to emitting it, over the last seconds.
+    const core::LatencyHistogram& conversionTimes() const noexcept {
+        return m_conversionTimes;
+    }
+
+    // When the last frame emitted was requested, on the clock of
+    // core::LatencyHistogram::now(), for the receiver to time the frame up
+    // to its paint. Read it on receipt: the next frame is only emitted after
+    // frameDelivered().
+    qint64 deliveredArrival() const noexcept {
+        return m_deliveredArrival.load(std::memory_order_relaxed);
+    }
+
+    // Converts at most rate frames per second, for cameras faster than the
+    // display; frames in between are skipped. 0, the default, converts every
+    // frame as soon as it arrives.
+    void setMaxRate(double rate) {
+        m_minInterval = rate > 0 ? qint64(1e9 / rate) : 0;
+    }
+
+    // High for the channel the user selected, whose frames are then
+    // converted before every other channel's.
+    void setPriority(Priority priority) {
+        m_priority = priority;
+    }
+
+    // 1 for full resolution, 2 or 4 to bin bayer quads into a smaller
+    // preview (see core::Image::ConversionOptions). Takes effect with the
+    // next frame.
+    void setBinning(int binning) {
+        if (binning != 1 && binning != 2 && binning != 4) {
+            return;
+        }
+
+        std::lock_guard lock(m_mutex);
+        m_options.binning = binning;
+    }
+
+    // Converts straight to the largest size fitting in the tile, so the GUI
+    // thread paints without rescaling. An empty size restores binning.
+    void setTargetSize(const QSize& size) {
+        std::lock_guard lock(m_mutex);
+        m_options.fitTo = size;
+    }
+
+    // Spreads each conversion over OpenCV's worker threads, for sensors too
+    // large for this converter's own thread to keep up with.
+    void setParallel(bool parallel) {
+        std::lock_guard lock(m_mutex);
+        m_options.parallel = parallel;
+    }
+
+    // Converts frames at the binning's resolution instead of the tile's,
+    // into a core::ImagePyramid delivered by pyramidAvailable(), for views
+    // that zoom or paint the channel at several sizes. Costs a conversion
+    // at that resolution plus a third of it for the halvings; use binning 2
+    // or 4 for large sensors.
+    void setPyramid(bool pyramid) {
+        std::lock_guard lock(m_mutex);
+        m_pyramid = pyramid;
+    }
+
+    // Demosaic of bayer frames converted at full resolution: nearest for
+    // thumbnails, bilinear for live view, edge-aware for measurements.
+    void setDemosaic(core::Image::Demosaic demosaic) {
+        std::lock_guard lock(m_mutex);
+        m_options.demosaic = demosaic;
+    }
+
+    // Maps bayer frames through window/level, curve and palette instead of
+    // keeping their top 8 bits; nullopt restores that. The lookup table is
+    // rebuilt on the converter thread with the next frame, and only when the
+    // mapping actually changed.
+    void setToneMapping(
+            const std::optional<core::Image::ToneMapping>& mapping) {
+        std::lock_guard lock(m_mutex);
+        if (mapping != m_toneMapping) {
+            m_toneMapping = mapping;
+            m_toneMappingChanged = true;
+        }
     }
 
 private:
+    struct Frame {
+        core::Image image;
+        // see core::LatencyHistogram::now()
+        qint64 arrived{0};
+    };
+
+    // Picks a destination the GUI thread no longer references. Two are
+    // enough in steady state: one being painted, one being converted into.
+    core::Image& outputFor(const QSize& size) {
+        for (auto& output : m_outputs) {
+            if (output.isDetached() && output.size() == size) {
+                return output;
+            }
+        }
+
+        auto& output = m_outputs[m_nextOutput];
+        m_nextOutput = (m_nextOutput + 1) % std::size(m_outputs);
+        output = core::Image(size, core::Image::paintableFormat,
+                             core::Image::Allocation::aligned);
+        return output;
+    }
+
+    static qint64 now() noexcept {
+        return core::LatencyHistogram::now();
+    }
+
+    // Before emitting a converted frame.
+    void converted(const Frame& frame, qint64 started) {
+        m_conversionTimes.record(now() - started);
+        m_deliveredArrival.store(frame.arrived, std::memory_order_relaxed);
+        m_delivering = true;
+    }
+
     QTimer m_timer;
-    core::Image m_image;
+    core::ConversionPool& m_pool;
+    std::atomic<bool> m_running{false};
+    // set from submit() until the task finds no newer frame
+    std::atomic<bool> m_busy{false};
+    // from emitting a frame until the GUI thread takes it, see
+    // frameDelivered()
+    std::atomic<bool> m_delivering{false};
+    std::atomic<Priority> m_priority{Priority::normal};
+    core::TripleBuffer<Frame> m_frames;
+    std::atomic<quint64> m_received{0};
+    core::LatencyHistogram m_conversionTimes;
+    std::atomic<qint64> m_deliveredArrival{0};
+    core::Image::ConversionOptions m_options;
+    bool m_pyramid = false;
+    // nanoseconds, 0 when uncapped
+    std::atomic<qint64> m_minInterval{0};
+    // steady clock nanoseconds, 0 before the first conversion
+    std::atomic<qint64> m_lastConversion{0};
+    std::optional<core::Image::ToneMapping> m_toneMapping;
+    bool m_toneMappingChanged = false;
+    // pool task only
+    std::shared_ptr<const core::ToneLut> m_toneLut;
     std::mutex m_mutex;
+    core::Image m_outputs[2];
+    std::size_t m_nextOutput = 0;
 
 Q_SIGNALS:
     void qRGB32Available(const QImage& image);
+    void pyramidAvailable(const core::ImagePyramidPointer& pyramid);
 
 public Q_SLOTS:
+    // Called from one thread only, the one delivering frames.
     bool requestConvert(const core::Image& image) {
         if (image.isNull()) {
             return false;
         }
 
-        std::lock_guard lock(m_mutex);
-        if (m_image.isNull()) {
-            m_image = image;
-            return true;
+        m_received.fetch_add(1, std::memory_order_relaxed);
+        // a frame already waiting has its task queued
+        if (m_frames.publish(Frame{image, now()})) {
+            schedule();
+        } else {
+            CORE_TRACE("ImageConverter skipped", image.width(),
+                       image.height());
         }
-        return false;
+        return true;
     }
 
     void start() {
-        if (!isStart()) {
-            m_timer.start();
-        }
+        m_running = true;
+        schedule();
+    }
+
+    // Called by the receiver once it took the last frame emitted. Until
+    // then no other is converted, so a GUI thread falling behind gets at
+    // most one frame per channel queued; newer frames wait in the triple
+    // buffer, replacing each other.
+    void frameDelivered() {
+        m_delivering.exchange(false, std::memory_order_acq_rel);
+        schedule();
     }
 
     void stop() {
-        if (isStart()) {
-            m_timer.stop();
-        }
+        m_running = false;
+        m_timer.stop();
     }
 
 private Q_SLOTS:
+    // Queues the waiting frame's conversion now, or once the rate cap allows.
+    void schedule() {
+        if (!m_running || m_timer.isActive() || m_delivering ||
+            !m_frames.hasNew()) {
+            return;
+        }
+
+        const qint64 minInterval = m_minInterval;
+        const qint64 last = m_lastConversion;
+        const qint64 wait = minInterval > 0 && last > 0
+                                    ? minInterval - (now() - last)
+                                    : 0;
+        if (wait > 0) {
+            m_timer.start(int((wait + 999999) / 1000000));
+        } else {
+            submit();
+        }
+    }
+
+    void submit() {
+        // one task per channel at a time, which keeps the pool fair
+        if (!m_busy.exchange(true, std::memory_order_acq_rel)) {
+            m_pool.submit(this, [this] { run(); }, m_priority);
+        }
+    }
+
+private:
+    void run() {
+        convert();
+        m_busy.exchange(false, std::memory_order_acq_rel);
+        // a frame published while converting found the task still busy;
+        // one that waits for delivery is queued by frameDelivered()
+        if (!m_running || m_delivering || !m_frames.hasNew()) {
+            return;
+        }
+        if (m_minInterval == 0) {
+            submit();
+        } else {
+            QMetaObject::invokeMethod(this, &ImageConverter::schedule,
+                                      Qt::QueuedConnection);
+        }
+    }
+
     void convert() {
+        if (!m_running || m_delivering) {
+            return;
+        }
+
+        Frame frame;
+        if (!m_frames.take(frame)) {
+            return;
+        }
+        const core::Image& image = frame.image;
+        CORE_TRACE_SCOPE("ImageConverter::convert", image.width(),
+                         image.height());
+
         std::unique_lock lock(m_mutex);
-        core::Image image = std::move(m_image);
+        auto options = m_options;
+        const bool pyramid = m_pyramid;
+        const bool retone = std::exchange(m_toneMappingChanged, false);
+        const auto toneMapping = m_toneMapping;
         lock.unlock();
 
-        QImage qimg = image.makePaintable();
+        if (retone) {
+            m_toneLut = toneMapping
+                                ? std::make_shared<const core::ToneLut>(
+                                          *toneMapping)
+                                : nullptr;
+        }
+        options.toneLut = m_toneLut;
+        const qint64 started = now();
+        m_lastConversion = started;
+
+        if (pyramid) {
+            convertPyramid(frame, options, started);
+            return;
+        }
+
+        QImage qimg;
+        const QSize outputSize = options.outputSize(image.size());
+        if (outputSize == image.size() &&
+            image.format() == core::Image::paintableFormat) {
+            qimg = image.toQImage();
+        } else {
+            core::Image& output = outputFor(outputSize);
+            if (image.convertInto(output, options)) {
+                qimg = output.toQImage();
+            }
+        }
 
         if (!qimg.isNull()) {
+            converted(frame, started);
             Q_EMIT qRGB32Available(qimg);
         }
     }
+
+    // A new base per frame: views may still paint the previous pyramid.
+    // Evicted levels hand their storage back to the buffer pool, so steady
+    // state reuses it instead of allocating frame buffers.
+    void convertPyramid(const Frame& frame,
+                        core::Image::ConversionOptions options,
+                        qint64 started) {
+        const core::Image& image = frame.image;
+        options.fitTo = QSize();
+        const QSize outputSize = options.outputSize(image.size());
+        core::Image base = image;
+        if (outputSize != image.size() ||
+            image.format() != core::Image::paintableFormat) {
+            base = core::Image(outputSize, core::Image::paintableFormat,
+                               core::Image::Allocation::aligned);
+            if (!image.convertInto(base, options)) {
+                return;
+            }
+        }
+        auto levels =
+                std::make_shared<const core::ImagePyramid>(std::move(base));
+        converted(frame, started);
+        Q_EMIT pyramidAvailable(levels);
+    }
 };
 #endif // IMAGEITEM_H
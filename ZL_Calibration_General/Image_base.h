@@ -4,9 +4,9 @@
 #include <QGraphicsObject>
 #include <QGraphicsLayoutItem>
 #include <QPainter>
-#include <QDebug>
-#include <QThread>
+#include <QElapsedTimer>
 #include "ImageItem.h"
+#include "trace.hpp"
 class ImageItemBase : public QGraphicsObject, public QGraphicsLayoutItem {
 	Q_OBJECT
 		Q_INTERFACES(QGraphicsLayoutItem)
@@ -19,7 +19,6 @@ public:
 	}
 
 	QRectF boundingRect() const override {
-		qDebug() << geometry().size();
 		return QRectF(QPointF(0, 0), geometry().size());
 		//return QRectF(QPointF(0, 0), QSizeF(300,300));
 	}
@@ -39,6 +38,31 @@ public:
 		return m_image;
 	}
 
+	// Time the GUI thread spent on this item's frames since it was created:
+	// taking each one from the converter, and painting.
+	struct PaintStatistics {
+		quint64 frames{0};
+		quint64 paints{0};
+		qint64 deliverNanoseconds{0};
+		qint64 paintNanoseconds{0};
+	};
+
+	// The frame path's figures, for PerformanceHud.
+	virtual PaintStatistics paintStatistics() const = 0;
+	virtual quint64 receivedFrames() const = 0;
+	virtual quint64 skippedFrames() const = 0;
+	virtual const core::LatencyHistogram& conversionTimes() const = 0;
+	virtual const core::LatencyHistogram& latencies() const = 0;
+
+	// 0 while every frame is converted.
+	virtual double displayRate() const {
+		return 0;
+	}
+
+	virtual QString displayRateReason() const {
+		return QString();
+	}
+
 protected:
 	virtual bool acceptImage(const core::Image& image) = 0;
 
@@ -62,72 +86,237 @@ class ImageItem :public ImageItemBase
 {
 	Q_OBJECT
 public:
+	// How converted frames reach the painter. The converter's output is
+	// already fitted to the tile and in QImage::Format_RGB32, which the
+	// raster engine blits as is, so image paints it without any copy.
+	// pixmap copies each frame into a QPixmap on the GUI thread first, which
+	// only pays off on viewports that keep pixmaps as textures, e.g. OpenGL.
+	enum class PaintMode { image, pixmap };
+
 	explicit ImageItem(QGraphicsItem* parent = nullptr) :
-		ImageItemBase(parent), m_thread(this),
+		ImageItemBase(parent),
 		m_converter(new ImageConverter())
 	{
-		m_converter->moveToThread(&m_thread);
-
-		connect(&m_thread, &QThread::finished, m_converter,
-			&ImageConverter::deleteLater);
+		// converted on the shared pool, delivered back on this thread
 		connect(m_converter, &ImageConverter::qRGB32Available, this,
-			&ImageItem::setPixmap);
-
-		m_thread.start();
+			&ImageItem::setFrame);
+		connect(m_converter, &ImageConverter::pyramidAvailable, this,
+			&ImageItem::setPyramid);
 	}
 	virtual ~ImageItem() {
-		QMetaObject::invokeMethod(m_converter, &ImageConverter::stop);
-		m_thread.quit();
-		m_thread.wait();
+		// waits for a conversion still running on the pool
+		delete m_converter;
+	}
+	// Converts frames binned by 2 or 4 instead of at full resolution, for
+	// tiles much smaller than the sensor. Only used while the item has no
+	// geometry, frames are otherwise converted to the tile size.
+	void setPreviewBinning(int binning) {
+		m_converter->setBinning(binning);
+	}
+
+	// Converts each frame in row bands across all cores.
+	void setParallelConversion(bool parallel) {
+		m_converter->setParallel(parallel);
+	}
+
+	void setDemosaic(core::Image::Demosaic demosaic) {
+		m_converter->setDemosaic(demosaic);
+	}
+
+	// Frames are converted as they arrive; a rate above 0 caps how many
+	// per second, for cameras faster than the screen refreshes. The reason,
+	// if any, is shown with the rate in the item's tooltip.
+	void setMaxDisplayRate(double rate, const QString& reason = QString()) {
+		m_converter->setMaxRate(rate);
+		m_displayRate = rate;
+		m_displayRateReason = reason;
+		const QString text = rate > 0
+			? QString("%1 fps").arg(rate, 0, 'f', 1) : QString("every frame");
+		setToolTip(reason.isEmpty() ? text : text + ", " + reason);
+	}
+
+	double displayRate() const override {
+		return m_displayRate;
+	}
+
+	QString displayRateReason() const override {
+		return m_displayRateReason;
+	}
+
+	// Converts this item's frames before those of normal priority ones, for
+	// the channel the user selected.
+	void setConversionPriority(core::ConversionPool::Priority priority) {
+		m_converter->setPriority(priority);
+	}
+
+	void setPaintMode(PaintMode mode) {
+		if (mode == m_paintMode) {
+			return;
+		}
+		m_paintMode = mode;
+		m_pixmap = mode == PaintMode::pixmap && !m_image.isNull()
+			? QPixmap::fromImage(m_image) : QPixmap();
+		update();
 	}
+
+	// Keeps each frame at full resolution and its halvings, painting from
+	// the level nearest to the size on screen, for views that zoom or show
+	// this item more than once. Frames are painted directly, whatever the
+	// paint mode.
+	void setZoomable(bool zoomable) {
+		m_converter->setPyramid(zoomable);
+	}
+
+	PaintStatistics paintStatistics() const override {
+		return m_paintStatistics;
+	}
+
+	// Frames dropped for a newer one before they were converted.
+	quint64 skippedFrames() const override {
+		return m_converter->skippedFrames();
+	}
+
+	quint64 receivedFrames() const override {
+		return m_converter->receivedFrames();
+	}
+
+	const core::LatencyHistogram& conversionTimes() const override {
+		return m_converter->conversionTimes();
+	}
+
+	// Time from a frame reaching the converter to its first paint, over the
+	// last seconds.
+	const core::LatencyHistogram& latencies() const override {
+		return m_latencies;
+	}
+
+	void setToneMapping(
+		const std::optional<core::Image::ToneMapping>& mapping) {
+		m_converter->setToneMapping(mapping);
+	}
+
+	void setGeometry(const QRectF& geom) override {
+		ImageItemBase::setGeometry(geom);
+		m_converter->setTargetSize(geom.size().toSize());
+		// redo the last frame at the new size, a paused stream would
+		// otherwise keep showing the old one stretched
+		if (!image().isNull()) {
+			m_converter->requestConvert(image());
+		}
+	}
+
 	virtual void paint(QPainter* painter, const QStyleOptionGraphicsItem*,
 		QWidget*) override {
-		qDebug() << "drawpix";
 		const QRectF rect = boundingRect();
+		CORE_TRACE_SCOPE("ImageItem::paint", qint64(rect.width()),
+			qint64(rect.height()));
 		if (rect.isEmpty()) {
-			qDebug() << "rect.isEmpty()";
 			return;
 		}
+		QElapsedTimer timer;
+		timer.start();
 		painter->fillRect(rect, Qt::black);
-		if (!m_pixmap) {
-			return;
+		const bool direct = m_paintMode == PaintMode::image;
+		const QSize frameSize = m_pyramid ? m_pyramid->size()
+			: direct ? m_image.size() : m_pixmap.size();
+		if (!frameSize.isEmpty()) {
+			// The converter already fits frames to the tile, they are only
+			// scaled here when converted before a resize or smaller than
+			// the tile, or when zoomable.
+			const QSizeF size =
+				QSizeF(frameSize).scaled(rect.size(), Qt::KeepAspectRatio);
+			const QRectF target(
+				rect.x() + (rect.width() - size.width()) * 0.5,
+				rect.y() + (rect.height() - size.height()) * 0.5,
+				size.width(), size.height());
+			const bool exact = target.size().toSize() == frameSize;
+			if (m_pyramid) {
+				// pixels this view covers, zoom included
+				const QSize onScreen =
+					painter->worldTransform().mapRect(target).size().toSize();
+				const QImage level =
+					m_pyramid->levelFor(onScreen).toQImage();
+				painter->drawImage(target, level, QRectF(level.rect()));
+			} else if (direct && exact) {
+				painter->drawImage(target.topLeft(), m_image);
+			} else if (direct) {
+				painter->drawImage(target, m_image, QRectF(m_image.rect()));
+			} else if (exact) {
+				painter->drawPixmap(target.topLeft(), m_pixmap);
+			} else {
+				painter->drawPixmap(target, m_pixmap,
+					QRectF(m_pixmap.rect()));
+			}
 		}
-		const QSize size = rect.size().toSize();
-		if (!m_scaled || m_scaled.size() != size) {
-			m_scaled = m_pixmap.scaled(size, Qt::KeepAspectRatio);
+		++m_paintStatistics.paints;
+		m_paintStatistics.paintNanoseconds += timer.nsecsElapsed();
+		// the first paint of each frame ends its latency
+		if (m_frameArrival) {
+			const qint64 now = core::LatencyHistogram::now();
+			m_latencies.record(now - std::exchange(m_frameArrival, 0), now);
 		}
-
-		const QPointF topLeft(
-			rect.x() + (rect.width() - m_scaled.width()) * 0.5,
-			rect.y() + (rect.height() - m_scaled.height()) * 0.5);
-		painter->drawPixmap(topLeft, m_scaled);
 	}
 
 protected:
 	virtual bool acceptImage(const core::Image& image) override {
 		if (!m_converter->isStart()) {
-			QMetaObject::invokeMethod(m_converter,
-				&ImageConverter::start);
+			m_converter->start();
 		}
 
 		return m_converter->requestConvert(image);
 	}
 private:
 
-	QThread m_thread;
 	ImageConverter* m_converter;
 
+	PaintMode m_paintMode = PaintMode::image;
+	// shares the converter's output buffer, no copy
 	QImage m_image;
+	// pixmap mode only
 	QPixmap m_pixmap;
-	QPixmap m_scaled;
+	// zoomable only, shared with every view painting this item
+	core::ImagePyramidPointer m_pyramid;
+	PaintStatistics m_paintStatistics;
+	// of the frame not painted yet, 0 once it is
+	qint64 m_frameArrival = 0;
+	core::LatencyHistogram m_latencies;
+	// 0 for every frame
+	double m_displayRate = 0;
+	QString m_displayRateReason;
 
 private Q_SLOTS:
-	void setPixmap(const QImage& image) {
+	void setFrame(const QImage& image) {
+		CORE_TRACE("ImageItem::setFrame", image.width(), image.height());
+		QElapsedTimer timer;
+		timer.start();
 		m_image = image;
-		m_pixmap = QPixmap::fromImage(image);
-		m_scaled = {};
+		m_pyramid.reset();
+		if (m_paintMode == PaintMode::pixmap) {
+			m_pixmap = QPixmap::fromImage(image);
+		}
+		++m_paintStatistics.frames;
+		m_paintStatistics.deliverNanoseconds += timer.nsecsElapsed();
+
+		m_frameArrival = m_converter->deliveredArrival();
+		update();
+		m_converter->frameDelivered();
+	}
+
+	// Replacing the previous frame's pyramid evicts it.
+	void setPyramid(const core::ImagePyramidPointer& pyramid) {
+		CORE_TRACE("ImageItem::setPyramid", pyramid->size().width(),
+			pyramid->size().height());
+		QElapsedTimer timer;
+		timer.start();
+		m_pyramid = pyramid;
+		m_image = QImage();
+		m_pixmap = QPixmap();
+		++m_paintStatistics.frames;
+		m_paintStatistics.deliverNanoseconds += timer.nsecsElapsed();
 
+		m_frameArrival = m_converter->deliveredArrival();
 		update();
+		m_converter->frameDelivered();
 	}
 };
 
@@ -0,0 +1,157 @@
+#ifndef PERFORMANCEHUD_H
+#define PERFORMANCEHUD_H
+
+#include <QElapsedTimer>
+#include <QFont>
+#include <QFontMetricsF>
+#include <QGraphicsObject>
+#include <QPainter>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include "Image_base.h"
+
+// One channel's performance figures, drawn over its top-left corner and
+// refreshed twice a second:
+//   in      frames per second reaching the converter
+//   shown   frames per second delivered to the item
+//   skipped frames per second replaced in the triple buffer unconverted
+//   convert median conversion time
+//   paint   mean paint time
+//   latency median and 99th percentile from reaching the converter to the
+//           first paint
+// The figures come from counters and histograms the frame path keeps
+// anyway, so the overlay costs nothing per frame and can stay on during
+// calibration runs. Text turns amber while the channel falls behind: its
+// display rate was lowered, or frames take over slowLatencyNanoseconds to
+// show.
+class PerformanceHud : public QGraphicsObject {
+    Q_OBJECT
+
+public:
+    static constexpr int refreshMilliseconds = 500;
+    static constexpr qint64 slowLatencyNanoseconds = 100'000'000;
+
+    explicit PerformanceHud(ImageItemBase* item,
+                            QGraphicsItem* parent = nullptr) :
+        QGraphicsObject(parent), m_item(item), m_timer(this) {
+        setZValue(1);
+        // readable whatever the view's zoom
+        setFlag(ItemIgnoresTransformations);
+        m_font.setStyleHint(QFont::Monospace);
+        m_last = sample();
+        m_clock.start();
+        m_timer.setInterval(refreshMilliseconds);
+        m_timer.callOnTimeout(this, &PerformanceHud::refresh);
+        m_timer.start();
+        refresh();
+    }
+
+    // The item showing the channel now, e.g. once it switched to tiled.
+    void setItem(ImageItemBase* item) {
+        m_item = item;
+        m_last = sample();
+        m_clock.restart();
+        refresh();
+    }
+
+    QRectF boundingRect() const override {
+        return QRectF(QPointF(0, 0), m_size);
+    }
+
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem*,
+               QWidget*) override {
+        painter->fillRect(boundingRect(), QColor(0, 0, 0, 160));
+        painter->setFont(m_font);
+        painter->setPen(m_behind ? QColor(255, 191, 0) : QColor(Qt::white));
+        const qreal lineHeight = QFontMetricsF(m_font).height();
+        for (int i = 0; i < m_lines.size(); ++i) {
+            painter->drawText(QRectF(margin, margin + i * lineHeight,
+                                     m_size.width() - 2 * margin, lineHeight),
+                              Qt::AlignLeft | Qt::AlignTop, m_lines[i]);
+        }
+    }
+
+private:
+    struct Sample {
+        quint64 received{0};
+        quint64 skipped{0};
+        ImageItemBase::PaintStatistics paint;
+    };
+
+    static constexpr qreal margin = 4;
+
+    Sample sample() const {
+        return Sample{m_item->receivedFrames(), m_item->skippedFrames(),
+                      m_item->paintStatistics()};
+    }
+
+    static QString milliseconds(qint64 nanoseconds) {
+        return QString::number(nanoseconds / 1e6, 'f', 1);
+    }
+
+    void refresh() {
+        const qint64 elapsed = m_clock.nsecsElapsed();
+        m_clock.restart();
+        const Sample now = sample();
+        const double seconds = (std::max)(elapsed / 1e9, 1e-3);
+        const auto perSecond = [&](quint64 from, quint64 to) {
+            return QString::number((to - from) / seconds, 'f', 1);
+        };
+        const quint64 paints = now.paint.paints - m_last.paint.paints;
+        const qint64 paintTime =
+                paints ? (now.paint.paintNanoseconds -
+                          m_last.paint.paintNanoseconds) /
+                                 qint64(paints)
+                       : 0;
+        const qint64 p50 = m_item->latencies().percentile(0.5);
+        const qint64 p99 = m_item->latencies().percentile(0.99);
+
+        m_lines = {
+                QString("in %1 fps  shown %2 fps")
+                        .arg(perSecond(m_last.received, now.received),
+                             perSecond(m_last.paint.frames,
+                                       now.paint.frames)),
+                QString("skipped %1/s")
+                        .arg(perSecond(m_last.skipped, now.skipped)),
+                QString("convert %1 ms  paint %2 ms")
+                        .arg(milliseconds(m_item->conversionTimes()
+                                                  .percentile(0.5)),
+                             milliseconds(paintTime)),
+                QString("latency p50 %1 ms  p99 %2 ms")
+                        .arg(milliseconds(p50), milliseconds(p99)),
+        };
+        if (!m_item->displayRateReason().isEmpty()) {
+            m_lines.append(QString("capped %1 fps: %2")
+                                   .arg(m_item->displayRate(), 0, 'f', 1)
+                                   .arg(m_item->displayRateReason()));
+        }
+        m_behind = !m_item->displayRateReason().isEmpty() ||
+                   p99 > slowLatencyNanoseconds;
+        m_last = now;
+
+        const QFontMetricsF metrics(m_font);
+        qreal width = 0;
+        for (const QString& line : m_lines) {
+            width = (std::max)(width, metrics.horizontalAdvance(line));
+        }
+        const QSizeF size(width + 2 * margin,
+                          m_lines.size() * metrics.height() + 2 * margin);
+        if (size != m_size) {
+            prepareGeometryChange();
+            m_size = size;
+        }
+        update();
+    }
+
+    ImageItemBase* m_item;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    Sample m_last;
+    QFont m_font;
+    QVector<QString> m_lines;
+    QSizeF m_size;
+    bool m_behind = false;
+};
+
+#endif // PERFORMANCEHUD_H
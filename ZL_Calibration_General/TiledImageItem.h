@@ -0,0 +1,449 @@
+#ifndef TILEDIMAGEITEM_H
+#define TILEDIMAGEITEM_H
+
+#include <QCache>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QWidget>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "Image_base.h"
+
+// Converts tiles of one frame on the shared ConversionPool. A tile at level
+// l covers tileSide << l frame pixels a side, scaled down to tileSide.
+class TileConverter : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int tileSide = 256;
+
+    struct Request {
+        core::Image frame;
+        quint64 serial{0};
+        int level{0};
+        // visible tiles first, then the prefetch margin
+        std::vector<QPoint> tiles;
+    };
+
+    explicit TileConverter(
+            QObject* parent = nullptr,
+            core::ConversionPool& pool = core::ConversionPool::instance()) :
+            QObject(parent), m_pool(pool) {}
+
+    // Waits for a conversion still running on the pool.
+    ~TileConverter() {
+        m_running = false;
+        m_pool.cancel(this);
+    }
+
+    // Every option but fitTo, which each tile sets.
+    void setOptions(const core::Image::ConversionOptions& options) {
+        std::lock_guard lock(m_mutex);
+        m_options = options;
+    }
+
+    // Replaces a request not started yet; one being converted stops after
+    // its current tile. Called from one thread only.
+    void request(Request request) {
+        if (m_requests.publish(std::move(request))) {
+            submit();
+        }
+    }
+
+    // Requests replaced by a newer one before they were started.
+    quint64 skippedRequests() const noexcept {
+        return m_requests.skipped();
+    }
+
+    // Time spent on each request taken, over the last seconds.
+    const core::LatencyHistogram& conversionTimes() const noexcept {
+        return m_conversionTimes;
+    }
+
+Q_SIGNALS:
+    void tileAvailable(quint64 serial, int level, const QPoint& tile,
+                       const QImage& image);
+
+private:
+    void submit() {
+        if (!m_busy.exchange(true, std::memory_order_acq_rel)) {
+            m_pool.submit(this, [this] { run(); });
+        }
+    }
+
+    void run() {
+        Request request;
+        if (m_running && m_requests.take(request)) {
+            const qint64 started = core::LatencyHistogram::now();
+            convert(request);
+            m_conversionTimes.record(core::LatencyHistogram::now() -
+                                     started);
+        }
+        m_busy.exchange(false, std::memory_order_acq_rel);
+        // not once the destructor started, cancel() would wait for it
+        if (m_running && m_requests.hasNew()) {
+            submit();
+        }
+    }
+
+    void convert(const Request& request) {
+        core::Image::ConversionOptions options;
+        {
+            std::lock_guard lock(m_mutex);
+            options = m_options;
+        }
+
+        const QRect frameRect(QPoint(0, 0), request.frame.size());
+        const int side = tileSide << request.level;
+        const int scale = 1 << request.level;
+        for (const QPoint& t : request.tiles) {
+            // panned, zoomed, a newer frame, or being destroyed
+            if (!m_running || m_requests.hasNew()) {
+                return;
+            }
+            const QRect source =
+                    QRect(t.x() * side, t.y() * side, side, side) &
+                    frameRect;
+            if (source.isEmpty()) {
+                continue;
+            }
+            options.fitTo = QSize((source.width() + scale - 1) / scale,
+                                  (source.height() + scale - 1) / scale);
+            core::Image tile(options.outputSize(source.size()),
+                             core::Image::paintableFormat,
+                             core::Image::Allocation::aligned);
+            if (request.frame.view(source).convertInto(tile, options)) {
+                Q_EMIT tileAvailable(request.serial, request.level, t,
+                                     tile.toQImage());
+            }
+        }
+    }
+
+    core::ConversionPool& m_pool;
+    std::atomic<bool> m_running{true};
+    std::atomic<bool> m_busy{false};
+    core::TripleBuffer<Request> m_requests;
+    core::LatencyHistogram m_conversionTimes;
+    core::Image::ConversionOptions m_options;
+    std::mutex m_mutex;
+};
+
+// An ImageItem for sensors far larger than the screen, zoomed in a
+// QGraphicsView. Converts only the tiles the view shows, plus a margin for
+// panning, at the coarsest level that still has a frame pixel per screen
+// pixel, so the work per frame follows the view's size rather than the
+// sensor's. Converted tiles are kept in a cache bounded in bytes; tiles not
+// converted yet for the current frame show the previous frame's, or a
+// coarser level's.
+//
+// Tracks the view that painted it last; for several views of one channel
+// use a zoomable ImageItem.
+class TiledImageItem : public ImageItemBase {
+    Q_OBJECT
+
+public:
+    static constexpr int tileSide = TileConverter::tileSide;
+    static constexpr qsizetype defaultCacheBytes = qsizetype(64) << 20;
+
+    explicit TiledImageItem(QGraphicsItem* parent = nullptr) :
+        ImageItemBase(parent), m_converter(new TileConverter()) {
+        m_tiles.setMaxCost(int(defaultCacheBytes >> 10));
+        // converted on the shared pool, delivered back on this thread
+        connect(m_converter, &TileConverter::tileAvailable, this,
+                &TiledImageItem::addTile);
+    }
+
+    ~TiledImageItem() {
+        delete m_converter;
+    }
+
+    // Bounds the converted tiles kept, whatever the sensor size; the least
+    // recently painted go first.
+    void setCacheBytes(qsizetype bytes) {
+        m_tiles.setMaxCost(int((std::max)(bytes >> 10, qsizetype(1))));
+    }
+
+    // Tiles converted around the visible ones on each side, 1 by default.
+    void setPrefetchTiles(int tiles) {
+        m_prefetch = (std::max)(tiles, 0);
+    }
+
+    void setConversionOptions(const core::Image::ConversionOptions& options) {
+        m_converter->setOptions(options);
+    }
+
+    PaintStatistics paintStatistics() const override {
+        return m_paintStatistics;
+    }
+
+    quint64 receivedFrames() const override {
+        return m_serial;
+    }
+
+    // Requests for a frame, pan or zoom replaced before they were started.
+    quint64 skippedFrames() const override {
+        return m_converter->skippedRequests();
+    }
+
+    const core::LatencyHistogram& conversionTimes() const override {
+        return m_converter->conversionTimes();
+    }
+
+    // Time from a frame being set to the first paint after one of its tiles
+    // arrived, over the last seconds.
+    const core::LatencyHistogram& latencies() const override {
+        return m_latencies;
+    }
+
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem*,
+               QWidget* widget) override {
+        QElapsedTimer timer;
+        timer.start();
+        paintTiles(painter, widget);
+        ++m_paintStatistics.paints;
+        m_paintStatistics.paintNanoseconds += timer.nsecsElapsed();
+        if (m_frameArrival) {
+            const qint64 now = core::LatencyHistogram::now();
+            m_latencies.record(now - std::exchange(m_frameArrival, 0), now);
+        }
+    }
+
+private:
+    void paintTiles(QPainter* painter, QWidget* widget) {
+        const QRectF rect = boundingRect();
+        if (rect.isEmpty()) {
+            return;
+        }
+        painter->fillRect(rect, Qt::black);
+        if (m_frameSize.isEmpty()) {
+            return;
+        }
+
+        const QRectF target = fitted(rect);
+        const qreal itemPerFrame = target.width() / m_frameSize.width();
+        // screen pixels per frame pixel, zoom included
+        const qreal zoom = painter->worldTransform().mapRect(target).width() /
+                           m_frameSize.width();
+        const int level = std::clamp(
+                int(std::floor(std::log2(1 / (std::max)(zoom, 1e-6)))), 0,
+                m_maxLevel);
+
+        QRectF visible = target;
+        if (widget) {
+            visible &= painter->worldTransform().inverted().mapRect(
+                    QRectF(widget->rect()));
+        }
+        if (visible.isEmpty()) {
+            return;
+        }
+        const QRectF visibleFrame(
+                (visible.topLeft() - target.topLeft()) / itemPerFrame,
+                visible.size() / itemPerFrame);
+        const qreal side = tileSide << level;
+        const QRect tiles(
+                QPoint(int(visibleFrame.left() / side),
+                       int(visibleFrame.top() / side)),
+                QPoint(int(std::ceil(visibleFrame.right() / side)) - 1,
+                       int(std::ceil(visibleFrame.bottom() / side)) - 1));
+        requestTiles(level, tiles);
+
+        for (int y = tiles.top(); y <= tiles.bottom(); ++y) {
+            for (int x = tiles.left(); x <= tiles.right(); ++x) {
+                drawTile(painter, target, itemPerFrame, level, QPoint(x, y));
+            }
+        }
+    }
+
+protected:
+    bool acceptImage(const core::Image& image) override {
+        if (image.isNull()) {
+            return false;
+        }
+        if (image.size() != m_frameSize) {
+            m_frameSize = image.size();
+            m_maxLevel = 0;
+            while ((tileSide << m_maxLevel) <
+                   (std::max)(m_frameSize.width(), m_frameSize.height())) {
+                ++m_maxLevel;
+            }
+            m_tiles.clear();
+            m_requestedLevel = -1;
+            // tiles of frames before are on the old grid
+            m_gridSerial = m_serial + 1;
+        }
+        m_frame = image;
+        ++m_serial;
+        m_arrival = core::LatencyHistogram::now();
+        if (m_requestedLevel >= 0) {
+            requestTiles(m_requestedLevel, m_requestedTiles);
+        }
+        update();
+        return true;
+    }
+
+private:
+    struct Tile {
+        quint64 serial;
+        QImage image;
+    };
+
+    static quint64 keyOf(int level, const QPoint& tile) noexcept {
+        return (quint64(level) << 48) | (quint64(quint32(tile.y())) << 24) |
+               quint64(quint32(tile.x()) & 0xffffff);
+    }
+
+    QRectF fitted(const QRectF& rect) const {
+        const QSizeF size =
+                QSizeF(m_frameSize).scaled(rect.size(), Qt::KeepAspectRatio);
+        return QRectF(rect.x() + (rect.width() - size.width()) * 0.5,
+                      rect.y() + (rect.height() - size.height()) * 0.5,
+                      size.width(), size.height());
+    }
+
+    // Tiles of the level covering the frame.
+    QRect tileGrid(int level) const {
+        const int side = tileSide << level;
+        return QRect(0, 0, (m_frameSize.width() + side - 1) / side,
+                     (m_frameSize.height() + side - 1) / side);
+    }
+
+    // Asks for the visible tiles of the current frame and the margin around
+    // them, once per frame and view change, no more than the cache holds.
+    void requestTiles(int level, const QRect& visible) {
+        if (m_frame.isNull() ||
+            (m_requestedSerial == m_serial && m_requestedLevel == level &&
+             m_requestedTiles == visible)) {
+            return;
+        }
+        m_requestedSerial = m_serial;
+        m_requestedLevel = level;
+        m_requestedTiles = visible;
+
+        const QRect grid = tileGrid(level);
+        const QRect wanted =
+                visible.adjusted(-m_prefetch, -m_prefetch, m_prefetch,
+                                 m_prefetch) &
+                grid;
+        const qsizetype tileKiB = qsizetype(tileSide) * tileSide * 4 >> 10;
+        const auto capacity = std::size_t(m_tiles.maxCost() / tileKiB);
+
+        TileConverter::Request request;
+        request.frame = m_frame;
+        request.serial = m_serial;
+        request.level = level;
+        for (int y = wanted.top(); y <= wanted.bottom(); ++y) {
+            for (int x = wanted.left(); x <= wanted.right(); ++x) {
+                request.tiles.emplace_back(x, y);
+            }
+        }
+        // visible first, nearest the middle of the view first
+        const QPointF middle =
+                QRectF(visible).center() - QPointF(0.5, 0.5);
+        const auto distance = [&](const QPoint& t) {
+            const bool outside = !visible.contains(t);
+            const qreal dx = t.x() - middle.x();
+            const qreal dy = t.y() - middle.y();
+            return std::pair(outside, dx * dx + dy * dy);
+        };
+        std::stable_sort(request.tiles.begin(), request.tiles.end(),
+                         [&](const QPoint& a, const QPoint& b) {
+                             return distance(a) < distance(b);
+                         });
+        if (request.tiles.size() > capacity) {
+            request.tiles.resize(capacity);
+        }
+        m_converter->request(std::move(request));
+    }
+
+    // The tile's own level when converted, else the first coarser level
+    // holding it, else nothing: the black background.
+    void drawTile(QPainter* painter, const QRectF& target, qreal itemPerFrame,
+                  int level, const QPoint& tile) {
+        const QRectF frameRect(QPointF(0, 0), QSizeF(m_frameSize));
+        const qreal side = tileSide << level;
+        const QRectF cell =
+                QRectF(tile.x() * side, tile.y() * side, side, side) &
+                frameRect;
+        const QRectF onItem(target.topLeft() + cell.topLeft() * itemPerFrame,
+                            cell.size() * itemPerFrame);
+
+        for (int l = level; l <= m_maxLevel; ++l) {
+            const int coarseSide = tileSide << l;
+            const QPoint coarse(tile.x() * int(side) / coarseSide,
+                                tile.y() * int(side) / coarseSide);
+            const Tile* cached = m_tiles.object(keyOf(l, coarse));
+            if (!cached) {
+                continue;
+            }
+            const QRectF covered =
+                    QRectF(coarse.x() * coarseSide, coarse.y() * coarseSide,
+                           coarseSide, coarseSide) &
+                    frameRect;
+            const qreal scale = cached->image.width() / covered.width();
+            const QRectF source((cell.topLeft() - covered.topLeft()) * scale,
+                                cell.size() * scale);
+            painter->drawImage(onItem, cached->image, source);
+            return;
+        }
+    }
+
+private Q_SLOTS:
+    void addTile(quint64 serial, int level, const QPoint& tile,
+                 const QImage& image) {
+        // a tile of a grid replaced since
+        if (serial < m_gridSerial) {
+            return;
+        }
+        const quint64 key = keyOf(level, tile);
+        const Tile* cached = m_tiles.object(key);
+        if (cached && cached->serial > serial) {
+            return;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        m_tiles.insert(key, new Tile{serial, image},
+                       (std::max)(int(image.sizeInBytes() >> 10), 1));
+        // a frame counts as shown with its first tile
+        if (serial > m_shownSerial) {
+            m_shownSerial = serial;
+            ++m_paintStatistics.frames;
+            if (serial == m_serial) {
+                m_frameArrival = m_arrival;
+            }
+        }
+        m_paintStatistics.deliverNanoseconds += timer.nsecsElapsed();
+        update();
+    }
+
+private:
+    TileConverter* m_converter;
+    // key of level and tile index
+    QCache<quint64, Tile> m_tiles;
+    int m_prefetch = 1;
+
+    core::Image m_frame;
+    QSize m_frameSize;
+    quint64 m_serial = 0;
+    // the first frame of the current size
+    quint64 m_gridSerial = 0;
+    int m_maxLevel = 0;
+
+    quint64 m_requestedSerial = 0;
+    int m_requestedLevel = -1;
+    QRect m_requestedTiles;
+
+    PaintStatistics m_paintStatistics;
+    // the newest frame a tile arrived for
+    quint64 m_shownSerial = 0;
+    // when m_frame was set
+    qint64 m_arrival = 0;
+    // of the frame not painted yet, 0 once it is
+    qint64 m_frameArrival = 0;
+    core::LatencyHistogram m_latencies;
+};
+
+#endif // TILEDIMAGEITEM_H
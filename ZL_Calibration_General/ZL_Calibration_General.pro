@@ -8,6 +8,10 @@ CONFIG += c++20
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Records frame path events into trace.json for chrome://tracing, see
+# trace.hpp.
+#DEFINES += CORE_TRACING
+
 SOURCES += \
     image.cpp \
     main.cpp \
@@ -16,13 +20,28 @@ SOURCES += \
 HEADERS += \
     CameraControllerView.h \
     CameraOutput.h \
+    DisplayGovernor.h \
     ImageItem.h \
     Image_base.h \
+    PerformanceHud.h \
+    TiledImageItem.h \
+    conversion_pool.hpp \
+    cpu_features.hpp \
     exception.hpp \
     global.hpp \
     image.h \
+    image_buffer_pool.hpp \
     image_conversion.hpp \
+    image_demosaic.hpp \
+    image_encode.hpp \
+    image_plan.hpp \
     image_private.hpp \
+    image_pyramid.hpp \
+    image_swizzle.hpp \
+    image_tone.hpp \
+    latency_histogram.hpp \
+    trace.hpp \
+    triple_buffer.hpp \
     mainwindow.h \
     ChannelViewerWidget.h
 
@@ -32,7 +51,9 @@ INCLUDEPATH += D:\\Boost\\include\\boost-1_79
 LIBS += -LD:/Boost/lib -lboost_system
 
 INCLUDEPATH += D:\\opencv-4.5.1\\build\\include
-LIBS += -LD:\\opencv-4.5.1\\build\\x64\\vc15\\lib -lopencv_world451d
+LIBS += -LD:\\opencv-4.5.1\\build\\x64\\vc15\\lib
+CONFIG(debug, debug|release): LIBS += -lopencv_world451d
+else: LIBS += -lopencv_world451
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,503 @@
+// Throughput, latency and allocations of every supported (from, to)
+// conversion, and of each demosaic tier for bayer sources with its kernels
+// per instruction set, plus clone(), saveBinary() and makePaintable() of
+// every format and the ImagePyramid of paintable frames, at several frame
+// sizes.
+// Prints a table, and with -o writes one CSV row per case so runs of two
+// builds can be compared line by line.
+//
+//   conversion_benchmark [-s vga,1080p,12mp,48mp] [-f filter] [-p]
+//                        [-t seconds] [-o results.csv]
+//
+//   -s  frame sizes to run, all four by default
+//   -f  only cases whose name contains filter, e.g. "bayer12_rggb>"
+//   -p  also run every conversion with ConversionOptions::parallel
+//   -t  time budget per case, 0.25 s by default
+//   -o  CSV output file
+//
+// allocs_per_call counts heap allocations per call: operator new, the image
+// buffer pool's included, plus one per cv::Mat data buffer. OpenCV's
+// UMatData header of a cv::Mat is not counted on top of its buffer.
+
+#include "cpu_features.hpp"
+#include "image.h"
+#include "image_conversion.hpp"
+#include "image_pyramid.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <QDir>
+#include <QFile>
+
+#include <opencv2/core.hpp>
+
+using core::Image;
+
+namespace {
+std::atomic<quint64> allocations{0};
+// Set while OpenCV's allocator runs: the UMatData header it news for a
+// cv::Mat is not counted, its data buffer is counted once instead.
+thread_local bool inMatAllocator = false;
+
+void* countedAlloc(std::size_t size, std::size_t alignment) {
+    if (!inMatAllocator) {
+        ++allocations;
+    }
+    size = size ? size : 1;
+#if defined(_MSC_VER)
+    void* p = _aligned_malloc(size, alignment);
+#else
+    void* p = alignment > alignof(std::max_align_t)
+                      ? std::aligned_alloc(alignment, (size + alignment - 1) /
+                                                              alignment *
+                                                              alignment)
+                      : std::malloc(size);
+#endif
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void countedFree(void* p) noexcept {
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+} // namespace
+
+// Every heap allocation of the process, the image buffer pool's included.
+void* operator new(std::size_t size) {
+    return countedAlloc(size, alignof(std::max_align_t));
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAlloc(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+    countedFree(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    countedFree(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+namespace {
+// cv::Mat data buffers come from fastMalloc(), bypassing operator new, so
+// each counts here as one allocation; the UMatData header alongside it is
+// bookkeeping of the same cv::Mat and is left out.
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data,
+                           size_t* step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override {
+        if (!data) {
+            ++allocations;
+        }
+        struct Scope {
+            Scope() noexcept {
+                inMatAllocator = true;
+            }
+            ~Scope() {
+                inMatAllocator = false;
+            }
+        } scope;
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data,
+                                                    step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags,
+                  cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(data, flags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+struct FrameSize {
+    const char* name;
+    int width;
+    int height;
+};
+
+constexpr FrameSize frameSizes[] = {
+        {"vga", 640, 480},
+        {"1080p", 1920, 1080},
+        {"12mp", 4000, 3000},
+        {"48mp", 8000, 6000},
+};
+
+struct DemosaicTier {
+    const char* mode;
+    Image::Demosaic demosaic;
+};
+
+// Besides the default bilinear; edge-aware always runs in parallel bands.
+constexpr DemosaicTier demosaicTiers[] = {
+        {"nearest", Image::Demosaic::nearest},
+        {"edge-aware", Image::Demosaic::edgeAware},
+};
+
+struct Settings {
+    std::vector<FrameSize> sizes;
+    std::string filter;
+    bool parallel{false};
+    double budget{0.25};
+    std::string output;
+};
+
+struct Result {
+    int iterations{0};
+    double mpixPerSecond{0};
+    double bytesPerCycle{0};
+    // see allocs_per_call above
+    double allocationsPerCall{0};
+    double p50Ms{0};
+    double p99Ms{0};
+};
+
+// Pixel data bytes; a call moves those of its source plus its destination.
+qsizetype bytesOf(const Image& image) {
+    return image.isNull() ? 0 : image.sizeInBytes();
+}
+
+template <class Run>
+Result measure(qsizetype pixels, qsizetype bytes, double budget,
+               const Run& run) {
+    constexpr int minIterations = 3;
+    constexpr int maxIterations = 1000;
+
+    run(); // warm up, allocate destinations and intermediates
+
+    // reserved up front so only the measured calls allocate
+    std::vector<double> ms;
+    std::vector<double> cycles;
+    ms.reserve(maxIterations);
+    cycles.reserve(maxIterations);
+    const quint64 allocationsBefore = allocations;
+    const auto begin = std::chrono::steady_clock::now();
+    for (;;) {
+        const auto start = std::chrono::steady_clock::now();
+        const qint64 startCycles = cv::getCPUTickCount();
+        run();
+        const qint64 stopCycles = cv::getCPUTickCount();
+        const auto stop = std::chrono::steady_clock::now();
+
+        ms.push_back(
+                std::chrono::duration<double, std::milli>(stop - start)
+                        .count());
+        cycles.push_back(double(stopCycles - startCycles));
+
+        const double elapsed =
+                std::chrono::duration<double>(stop - begin).count();
+        if (int(ms.size()) >= maxIterations ||
+            (int(ms.size()) >= minIterations && elapsed >= budget)) {
+            break;
+        }
+    }
+
+    Result result;
+    result.iterations = int(ms.size());
+    result.allocationsPerCall =
+            double(allocations - allocationsBefore) / result.iterations;
+
+    const auto percentile = [](std::vector<double> v, double p) {
+        std::sort(v.begin(), v.end());
+        return v[std::min(v.size() - 1, std::size_t(p * v.size()))];
+    };
+    result.p50Ms = percentile(ms, 0.50);
+    result.p99Ms = percentile(ms, 0.99);
+    result.mpixPerSecond = pixels / 1e6 / (result.p50Ms / 1e3);
+    const double medianCycles = percentile(cycles, 0.50);
+    result.bytesPerCycle = medianCycles > 0 ? bytes / medianCycles : 0;
+    return result;
+}
+
+// Random contents; a fast generator, 48 MP frames are large.
+void fill(Image& image) {
+    quint64 state = 0x9e3779b97f4a7c15ull ^ quint64(image.format());
+    uchar* data = image.bits();
+    for (qsizetype i = 0; i < image.sizeInBytes(); i += 8) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        const qsizetype n = std::min<qsizetype>(8, image.sizeInBytes() - i);
+        std::memcpy(data + i, &state, std::size_t(n));
+    }
+}
+
+class Report {
+public:
+    explicit Report(const std::string& output) {
+        if (!output.empty()) {
+            m_csv = std::fopen(output.c_str(), "w");
+            if (!m_csv) {
+                std::fprintf(stderr, "cannot write %s\n", output.c_str());
+            } else {
+                std::fprintf(m_csv, "size,case,mode,iterations,mpix_per_s,"
+                                    "bytes_per_cycle,allocs_per_call,p50_ms,"
+                                    "p99_ms\n");
+            }
+        }
+        std::printf("%-6s %-32s %-17s %6s %10s %8s %8s %10s %10s\n", "size",
+                    "case", "mode", "iters", "MPix/s", "B/cycle", "allocs",
+                    "p50 ms", "p99 ms");
+    }
+
+    ~Report() {
+        if (m_csv) {
+            std::fclose(m_csv);
+        }
+    }
+
+    Report(const Report&) = delete;
+    Report& operator=(const Report&) = delete;
+
+    void add(const char* size, const std::string& name, const char* mode,
+             const Result& r) {
+        std::printf("%-6s %-32s %-17s %6d %10.1f %8.2f %8.2f %10.3f %10.3f\n",
+                    size, name.c_str(), mode, r.iterations, r.mpixPerSecond,
+                    r.bytesPerCycle, r.allocationsPerCall, r.p50Ms, r.p99Ms);
+        std::fflush(stdout);
+        if (m_csv) {
+            std::fprintf(m_csv, "%s,%s,%s,%d,%.3f,%.4f,%.3f,%.4f,%.4f\n", size,
+                         name.c_str(), mode, r.iterations, r.mpixPerSecond,
+                         r.bytesPerCycle, r.allocationsPerCall, r.p50Ms,
+                         r.p99Ms);
+            std::fflush(m_csv);
+        }
+    }
+
+private:
+    std::FILE* m_csv{nullptr};
+};
+
+// The nearest and edge-aware kernels alone over a whole frame of an unpacked
+// bayer source into layout L, serially, with no instruction set beyond the
+// baseline and then with each one they use that this machine has: modes
+// "nearest scalar", "nearest ssse3", "edge-aware scalar" and "edge-aware
+// avx2". The tier modes above run whichever the machine selects.
+template <class L, class T>
+void measureKernels(Report& report, const char* size, const std::string& name,
+                    const Image& src, qsizetype bytes, double budget) {
+    namespace demosaic = core::image_conversion::demosaic;
+
+    const int bits = core::bitPlaneCountForFormat(src.format());
+    const cv::Mat mosaic(src.height(), src.width(),
+                         sizeof(T) == 1 ? CV_8UC1 : CV_16UC1,
+                         const_cast<uchar*>(src.bits()),
+                         std::size_t(src.bytesPerLine()));
+    const int cfa = demosaic::cfaIndex(src.format());
+    const demosaic::ShiftMapping map{sizeof(T) == 1 ? 0 : bits - 8};
+    cv::Mat dst(src.height(), src.width(), CV_MAKETYPE(CV_8U, L::channels));
+    const qsizetype pixels = qsizetype(src.width()) * src.height();
+
+    const core::CpuFeatures baseline;
+    const core::CpuFeatures& cpu = core::cpuFeatures();
+    const auto nearest = [&](const core::CpuFeatures& features) {
+        return measure(pixels, bytes, budget, [&] {
+            demosaic::nearestUsing<L, T>(features, mosaic, cfa, map, dst, 0,
+                                         dst.rows);
+        });
+    };
+    const auto edgeAware = [&](const core::CpuFeatures& features) {
+        return measure(pixels, bytes, budget, [&] {
+            demosaic::edgeAwareUsing<L, T>(features, mosaic, cfa, map, dst,
+                                           0, dst.rows);
+        });
+    };
+
+    report.add(size, name, "nearest scalar", nearest(baseline));
+    if (cpu.ssse3) {
+        core::CpuFeatures ssse3;
+        ssse3.ssse3 = true;
+        report.add(size, name, "nearest ssse3", nearest(ssse3));
+    }
+    report.add(size, name, "edge-aware scalar", edgeAware(baseline));
+    if (cpu.avx2) {
+        core::CpuFeatures avx2;
+        avx2.avx2 = true;
+        report.add(size, name, "edge-aware avx2", edgeAware(avx2));
+    }
+}
+
+template <class L>
+void measureKernels(Report& report, const char* size, const std::string& name,
+                    const Image& src, qsizetype bytes, double budget) {
+    if (core::bitPlaneCountForFormat(src.format()) > 8) {
+        measureKernels<L, ushort>(report, size, name, src, bytes, budget);
+    } else {
+        measureKernels<L, uchar>(report, size, name, src, bytes, budget);
+    }
+}
+
+bool parseArguments(int argc, char* argv[], Settings& settings) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "-p") {
+            settings.parallel = true;
+        } else if (arg == "-s" && hasValue) {
+            const std::string list = argv[++i];
+            for (const FrameSize& size : frameSizes) {
+                if (list.find(size.name) != std::string::npos) {
+                    settings.sizes.push_back(size);
+                }
+            }
+        } else if (arg == "-f" && hasValue) {
+            settings.filter = argv[++i];
+        } else if (arg == "-t" && hasValue) {
+            settings.budget = std::atof(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            settings.output = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    if (settings.sizes.empty()) {
+        settings.sizes.assign(std::begin(frameSizes), std::end(frameSizes));
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        std::fprintf(stderr,
+                     "usage: %s [-s vga,1080p,12mp,48mp] [-f filter] [-p] "
+                     "[-t seconds] [-o results.csv]\n",
+                     argv[0]);
+        return 2;
+    }
+
+    static CountingMatAllocator matAllocator;
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    const QString rawFile =
+            QDir(QDir::tempPath()).filePath("conversion_benchmark.raw");
+    const auto selected = [&](const std::string& name) {
+        return settings.filter.empty() ||
+               name.find(settings.filter) != std::string::npos;
+    };
+
+    Report report(settings.output);
+    for (const FrameSize& size : settings.sizes) {
+        const qsizetype pixels = qsizetype(size.width) * size.height;
+
+        for (int f = 1; f < Image::formatCount; ++f) {
+            const auto from = Image::Format(f);
+            Image src(size.width, size.height, from,
+                      Image::Allocation::aligned);
+            fill(src);
+
+            for (int t = 1; t < Image::formatCount; ++t) {
+                const auto to = Image::Format(t);
+                const std::string name =
+                        std::string(core::formatName(from)) + ">" +
+                        core::formatName(to);
+                if (from == to || !selected(name) ||
+                    !Image::canConvert(from, to)) {
+                    continue;
+                }
+
+                Image dst(size.width, size.height, to,
+                          Image::Allocation::aligned);
+                const qsizetype bytes = bytesOf(src) + bytesOf(dst);
+                report.add(size.name, name, "serial",
+                           measure(pixels, bytes, settings.budget,
+                                   [&] { src.convertInto(dst); }));
+
+                if (settings.parallel) {
+                    Image::ConversionOptions options;
+                    options.parallel = true;
+                    report.add(size.name, name, "parallel",
+                               measure(pixels, bytes, settings.budget, [&] {
+                                   src.convertInto(dst, options);
+                               }));
+                }
+
+                // the other demosaic tiers of bayer sources
+                if (core::image_conversion::getDemosaicConverter(from, to)) {
+                    for (const auto& [mode, demosaic] : demosaicTiers) {
+                        Image::ConversionOptions options;
+                        options.demosaic = demosaic;
+                        report.add(size.name, name, mode,
+                                   measure(pixels, bytes, settings.budget, [&] {
+                                       src.convertInto(dst, options);
+                                   }));
+                    }
+                }
+
+                // their kernels per instruction set, for the paintable
+                // target and a three channel one
+                if (core::image_conversion::getDemosaicConverter(from, to) &&
+                    !core::isPackedFormat(from)) {
+                    namespace demosaic = core::image_conversion::demosaic;
+                    if (to == Image::bgra32) {
+                        measureKernels<demosaic::BgraLayout>(
+                                report, size.name, name, src, bytes,
+                                settings.budget);
+                    } else if (to == Image::rgb24) {
+                        measureKernels<demosaic::RgbLayout>(
+                                report, size.name, name, src, bytes,
+                                settings.budget);
+                    }
+                }
+            }
+
+            const std::string clone =
+                    std::string("clone ") + core::formatName(from);
+            if (selected(clone)) {
+                report.add(size.name, clone, "serial",
+                           measure(pixels, 2 * bytesOf(src), settings.budget,
+                                   [&] { src.clone(); }));
+            }
+
+            const std::string save =
+                    std::string("saveBinary ") + core::formatName(from);
+            if (selected(save)) {
+                report.add(size.name, save, "serial",
+                           measure(pixels, bytesOf(src), settings.budget,
+                                   [&] { src.saveBinary(rawFile); }));
+            }
+
+            if (from == Image::paintableFormat && selected("pyramid")) {
+                // levels of a third of the base's bytes, read once more
+                report.add(size.name, "pyramid", "serial",
+                           measure(pixels, bytesOf(src), settings.budget,
+                                   [&] { core::ImagePyramid pyramid(src); }));
+            }
+
+            const std::string paintable =
+                    std::string("makePaintable ") + core::formatName(from);
+            if (selected(paintable)) {
+                const qsizetype paintableBytes = pixels * 4 + bytesOf(src);
+                report.add(size.name, paintable, "serial",
+                           measure(pixels, paintableBytes, settings.budget,
+                                   [&] { src.makePaintable(); }));
+            }
+        }
+    }
+
+    QFile::remove(rawFile);
+    return 0;
+}
@@ -0,0 +1,185 @@
+// GUI thread time per frame of ImageItem's two paint modes, at the tile
+// sizes a channel grid uses: a real ImageItem takes each frame through its
+// setFrame() slot, as the converter delivers it, then paints it into a
+// raster backing store. "pixmap" copies each frame into a QPixmap first,
+// "image" paints the converter's QImage as is; the scaled cases are frames
+// converted before a resize, drawn 10% larger.
+//
+// deliver and paint are the item's own paintStatistics() per frame; p50 and
+// p99 time both together from outside.
+//
+//   paint_benchmark [-t seconds] [-o results.csv]
+//
+//   -t  time budget per case, 0.5 s by default
+//   -o  CSV output file
+
+#include "Image_base.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <QApplication>
+#include <QImage>
+#include <QMetaObject>
+#include <QPainter>
+
+namespace {
+struct TileSize {
+    const char* name;
+    int width;
+    int height;
+};
+
+constexpr TileSize tileSizes[] = {
+        {"vga", 640, 480},
+        {"960p", 1280, 960},
+        {"1080p", 1920, 1080},
+        {"4k", 3840, 2160},
+};
+
+struct Result {
+    int frames{0};
+    // from ImageItem::paintStatistics(), per frame
+    double deliverMs{0};
+    double paintMs{0};
+    double p50Ms{0};
+    double p99Ms{0};
+};
+
+// The converter alternates between two outputs, ImageConverter::outputFor().
+std::vector<QImage> makeFrames(const TileSize& size) {
+    std::vector<QImage> frames;
+    for (int i = 0; i < 2; ++i) {
+        QImage frame(size.width, size.height, QImage::Format_RGB32);
+        for (int y = 0; y < frame.height(); ++y) {
+            auto* line = reinterpret_cast<quint32*>(frame.scanLine(y));
+            for (int x = 0; x < frame.width(); ++x) {
+                line[x] = 0xff000000u | quint32((x + i) * 7 + y * 3);
+            }
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// Frames delivered to item and each painted once into backingStore, until
+// the budget runs out.
+Result measure(double budget, ImageItem& item,
+               const std::vector<QImage>& frames, QImage& backingStore) {
+    constexpr int minFrames = 5;
+    constexpr int maxFrames = 2000;
+
+    const auto frame = [&](int i) {
+        // the converter's queued delivery, made directly
+        QMetaObject::invokeMethod(&item, "setFrame", Qt::DirectConnection,
+                                  Q_ARG(QImage, frames[i % 2]));
+        QPainter painter(&backingStore);
+        item.paint(&painter, nullptr, nullptr);
+    };
+
+    frame(0); // warm up
+    const ImageItem::PaintStatistics before = item.paintStatistics();
+
+    std::vector<double> ms;
+    ms.reserve(maxFrames);
+    const auto begin = std::chrono::steady_clock::now();
+    for (int i = 1;; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        frame(i);
+        const auto stop = std::chrono::steady_clock::now();
+        ms.push_back(std::chrono::duration<double, std::milli>(stop - start)
+                             .count());
+
+        const double elapsed =
+                std::chrono::duration<double>(stop - begin).count();
+        if (int(ms.size()) >= maxFrames ||
+            (int(ms.size()) >= minFrames && elapsed >= budget)) {
+            break;
+        }
+    }
+
+    const ImageItem::PaintStatistics after = item.paintStatistics();
+    std::sort(ms.begin(), ms.end());
+    Result result;
+    result.frames = int(ms.size());
+    result.deliverMs =
+            (after.deliverNanoseconds - before.deliverNanoseconds) / 1e6 /
+            double(after.frames - before.frames);
+    result.paintMs = (after.paintNanoseconds - before.paintNanoseconds) /
+                     1e6 / double(after.paints - before.paints);
+    result.p50Ms = ms[ms.size() / 2];
+    result.p99Ms = ms[std::min(ms.size() - 1, std::size_t(0.99 * ms.size()))];
+    return result;
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double budget = 0.5;
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) {
+            budget = std::atof(argv[++i]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [-t seconds] [-o results.csv]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    // ImageItem is a QGraphicsWidget item, QPixmap needs a GUI
+    QApplication app(argc, argv);
+
+    std::FILE* csv = output.empty() ? nullptr : std::fopen(output.c_str(), "w");
+    if (csv) {
+        std::fprintf(csv, "size,mode,scaled,frames,deliver_ms,paint_ms,"
+                          "p50_ms,p99_ms\n");
+    }
+    std::printf("%-6s %-7s %-7s %7s %10s %10s %10s %10s\n", "size", "mode",
+                "scaled", "frames", "deliver ms", "paint ms", "p50 ms",
+                "p99 ms");
+
+    for (const TileSize& size : tileSizes) {
+        const std::vector<QImage> frames = makeFrames(size);
+
+        for (const bool scaled : {false, true}) {
+            // the raster engine's backing store format
+            const QSize tile = scaled ? QSize(size.width * 11 / 10,
+                                              size.height * 11 / 10)
+                                      : QSize(size.width, size.height);
+            QImage backingStore(tile, QImage::Format_ARGB32_Premultiplied);
+
+            for (const auto& [mode, paintMode] :
+                 {std::pair{"image", ImageItem::PaintMode::image},
+                  std::pair{"pixmap", ImageItem::PaintMode::pixmap}}) {
+                ImageItem item;
+                item.setPaintMode(paintMode);
+                item.setGeometry(QRectF(QPointF(0, 0), QSizeF(tile)));
+                const Result r = measure(budget, item, frames, backingStore);
+
+                std::printf("%-6s %-7s %-7s %7d %10.3f %10.3f %10.3f "
+                            "%10.3f\n",
+                            size.name, mode, scaled ? "yes" : "no", r.frames,
+                            r.deliverMs, r.paintMs, r.p50Ms, r.p99Ms);
+                if (csv) {
+                    std::fprintf(csv, "%s,%s,%d,%d,%.4f,%.4f,%.4f,%.4f\n",
+                                 size.name, mode, int(scaled), r.frames,
+                                 r.deliverMs, r.paintMs, r.p50Ms, r.p99Ms);
+                }
+            }
+            std::fflush(stdout);
+        }
+    }
+
+    if (csv) {
+        std::fclose(csv);
+    }
+    return 0;
+}
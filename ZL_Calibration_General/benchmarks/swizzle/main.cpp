@@ -0,0 +1,201 @@
+// Throughput of the swizzle kernels against the cvtColor/mixChannels chains
+// the converters used before, for every pair of 8-bit rgb layouts. Each
+// kernel's output is first compared byte for byte with the legacy path's;
+// one that differs prints "differs" in place of its throughput, and the
+// benchmark exits with 1.
+//
+//   swizzle_benchmark [width height [iterations]]
+
+#include "image_private.hpp"
+#include "image_swizzle.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+using core::Image;
+using namespace core::image_conversion;
+
+namespace {
+constexpr Image::Format formats[] = {Image::rgb24,  Image::bgr24,
+                                     Image::rgba32, Image::bgra32,
+                                     Image::argb32, Image::abgr32};
+
+bool isAlphaFirst(Image::Format format) {
+    return format == Image::argb32 || format == Image::abgr32;
+}
+
+// cvtColor code between the layouts OpenCV knows, or -1.
+int cvtCode(Image::Format from, Image::Format to) {
+    struct Entry {
+        Image::Format from, to;
+        int code;
+    };
+    static constexpr Entry codes[] = {
+            {Image::rgb24, Image::bgr24, cv::COLOR_RGB2BGR},
+            {Image::rgb24, Image::rgba32, cv::COLOR_RGB2RGBA},
+            {Image::rgb24, Image::bgra32, cv::COLOR_RGB2BGRA},
+            {Image::bgr24, Image::rgb24, cv::COLOR_BGR2RGB},
+            {Image::bgr24, Image::rgba32, cv::COLOR_BGR2RGBA},
+            {Image::bgr24, Image::bgra32, cv::COLOR_BGR2BGRA},
+            {Image::rgba32, Image::rgb24, cv::COLOR_RGBA2RGB},
+            {Image::rgba32, Image::bgr24, cv::COLOR_RGBA2BGR},
+            {Image::rgba32, Image::bgra32, cv::COLOR_RGBA2BGRA},
+            {Image::bgra32, Image::rgb24, cv::COLOR_BGRA2RGB},
+            {Image::bgra32, Image::bgr24, cv::COLOR_BGRA2BGR},
+            {Image::bgra32, Image::rgba32, cv::COLOR_BGRA2RGBA},
+    };
+    for (const Entry& e : codes) {
+        if (e.from == from && e.to == to) {
+            return e.code;
+        }
+    }
+    return -1;
+}
+
+// The previous conversion path: cvtColor between the OpenCV layouts,
+// mixChannels out of argb/abgr, and rgba/bgra plus mixChannels into them.
+void legacy(const cv::Mat& src, Image::Format from, Image::Format to,
+            cv::Mat& tmp, cv::Mat& dst) {
+    const int toChannels = swizzle_detail::channelPositions(to).channels;
+    if (isAlphaFirst(from)) {
+        const auto src4 = swizzle_detail::channelPositions(from);
+        const auto dst4 = swizzle_detail::channelPositions(to);
+        std::vector<int> fromTo;
+        for (int k = 0; k < 4; ++k) {
+            if (dst4.position[k] >= 0) {
+                fromTo.push_back(src4.position[k]);
+                fromTo.push_back(dst4.position[k]);
+            }
+        }
+        dst.create(src.rows, src.cols, CV_MAKETYPE(CV_8U, toChannels));
+        cv::mixChannels(&src, 1, &dst, 1, fromTo.data(), fromTo.size() / 2);
+        return;
+    }
+
+    if (isAlphaFirst(to)) {
+        const Image::Format via =
+                to == Image::argb32 ? Image::rgba32 : Image::bgra32;
+        if (from == via) {
+            src.copyTo(tmp);
+        } else {
+            cv::cvtColor(src, tmp, cvtCode(from, via));
+        }
+        constexpr const int fromTo[] = {0, 1, 1, 2, 2, 3, 3, 0};
+        dst.create(src.rows, src.cols, CV_8UC4);
+        cv::mixChannels(&tmp, 1, &dst, 1, &fromTo[0], 4);
+        return;
+    }
+
+    cv::cvtColor(src, dst, cvtCode(from, to));
+}
+
+// Same size, type and pixels; row padding is not compared.
+bool sameBytes(const cv::Mat& a, const cv::Mat& b) {
+    if (a.rows != b.rows || a.cols != b.cols || a.type() != b.type()) {
+        return false;
+    }
+    const std::size_t rowBytes = std::size_t(a.cols) * a.elemSize();
+    for (int y = 0; y < a.rows; ++y) {
+        if (std::memcmp(a.ptr(y), b.ptr(y), rowBytes) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double medianMs(int iterations, const std::function<void()>& run) {
+    run(); // warm up, allocate destinations
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const auto stop = std::chrono::steady_clock::now();
+        samples.push_back(
+                std::chrono::duration<double, std::milli>(stop - start)
+                        .count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int width = argc > 2 ? std::atoi(argv[1]) : 1920;
+    const int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 50;
+    const double mpix = double(width) * height / 1e6;
+
+    [[maybe_unused]] const auto& cpu = core::cpuFeatures();
+    struct Kernel {
+        const char* name;
+        SwizzleRow row;
+        bool supported;
+    };
+    const Kernel kernels[] = {
+            {"scalar", &swizzleRowScalar, true},
+#ifdef CORE_X86
+            {"ssse3", &swizzleRowSsse3, cpu.ssse3},
+            {"avx2", &swizzleRowAvx2, cpu.avx2},
+            {"avx512", &swizzleRowAvx512, cpu.avx512bw},
+#endif
+    };
+
+    std::printf("%dx%d, %d iterations, MPix/s (median)\n", width, height,
+                iterations);
+    std::printf("%-16s %10s", "pair", "legacy");
+    for (const Kernel& k : kernels) {
+        std::printf(" %10s", k.name);
+    }
+    std::printf("\n");
+
+    cv::RNG rng;
+    cv::Mat tmp, expected, dst;
+    int mismatches = 0;
+    for (Image::Format from : formats) {
+        const int cn = swizzle_detail::channelPositions(from).channels;
+        cv::Mat src(height, width, CV_MAKETYPE(CV_8U, cn));
+        rng.fill(src, cv::RNG::UNIFORM, 0, 256);
+
+        for (Image::Format to : formats) {
+            if (from == to) {
+                continue;
+            }
+
+            char pair[32];
+            std::snprintf(pair, sizeof(pair), "%s>%s",
+                          core::formatName(from), core::formatName(to));
+            std::printf("%-16s %10.1f", pair, mpix / medianMs(iterations, [&] {
+                legacy(src, from, to, tmp, dst);
+            }) * 1e3);
+
+            legacy(src, from, to, tmp, expected);
+            const SwizzlePlan plan = swizzlePlan(from, to);
+            for (const Kernel& k : kernels) {
+                if (!k.supported) {
+                    std::printf(" %10s", "-");
+                    continue;
+                }
+                swizzle(src, plan, dst, k.row);
+                if (!sameBytes(expected, dst)) {
+                    std::printf(" %10s", "differs");
+                    ++mismatches;
+                    continue;
+                }
+                std::printf(" %10.1f", mpix / medianMs(iterations, [&] {
+                    swizzle(src, plan, dst, k.row);
+                }) * 1e3);
+            }
+            std::printf("\n");
+        }
+    }
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = swizzle_benchmark
+
+QT += core gui
+
+CONFIG += console c++20
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp
+
+INCLUDEPATH += D:\\Boost\\include\\boost-1_79
+LIBS += -LD:/Boost/lib -lboost_system
+
+INCLUDEPATH += D:\\opencv-4.5.1\\build\\include
+LIBS += -LD:\\opencv-4.5.1\\build\\x64\\vc15\\lib
+CONFIG(debug, debug|release): LIBS += -lopencv_world451d
+else: LIBS += -lopencv_world451
@@ -0,0 +1,97 @@
+// Destroys display and tile converters while frames keep arriving and
+// their tasks keep resubmitting themselves on the shared ConversionPool, the
+// teardown ConversionPool::cancel() has to make safe: a task queued by one
+// still running must not outlive its converter. Build with AddressSanitizer or
+// ThreadSanitizer, which report a use after free; without them it may only
+// crash now and then.
+//
+//   teardown_stress [-n rounds]
+//
+//   -n  converters created and destroyed, 2000 by default
+
+#include "ImageItem.h"
+#include "TiledImageItem.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <QCoreApplication>
+
+namespace {
+// Large enough for a conversion to still be running when its converter is
+// destroyed, small enough for thousands of rounds.
+core::Image makeFrame() {
+    return core::Image(1280, 960, core::Image::bayer8_rggb,
+                       core::Image::Allocation::zeroed);
+}
+
+void testImageConverters(int rounds) {
+    const core::Image frames[2] = {makeFrame(), makeFrame()};
+    quint64 converted = 0;
+    for (int i = 0; i < rounds; ++i) {
+        auto* converter = new ImageConverter();
+        converter->setTargetSize(QSize(640, 480));
+        // delivered back on this thread, as to an ImageItem
+        QObject::connect(converter, &ImageConverter::qRGB32Available,
+                         converter, [&converted, converter] {
+                             ++converted;
+                             converter->frameDelivered();
+                         });
+        converter->start();
+        // frames keep arriving up to the moment the converter goes
+        for (int f = 0; f <= i % 8; ++f) {
+            converter->requestConvert(frames[f % 2]);
+            QCoreApplication::processEvents();
+        }
+        delete converter;
+    }
+    std::printf("ImageConverter: %d destroyed, %llu frames converted\n",
+                rounds, static_cast<unsigned long long>(converted));
+}
+
+// Requests replacing each other while tiles convert, as when panning.
+void testTileConverters(int rounds) {
+    const core::Image frame = makeFrame();
+    quint64 tiles = 0;
+    for (int i = 0; i < rounds; ++i) {
+        auto* converter = new TileConverter();
+        QObject::connect(converter, &TileConverter::tileAvailable, converter,
+                         [&tiles] { ++tiles; });
+        for (int r = 0; r <= i % 8; ++r) {
+            TileConverter::Request request;
+            request.frame = frame;
+            request.serial = quint64(r);
+            request.level = r % 2;
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 5; ++x) {
+                    request.tiles.emplace_back(x, y);
+                }
+            }
+            converter->request(std::move(request));
+            QCoreApplication::processEvents();
+        }
+        delete converter;
+    }
+    std::printf("TileConverter: %d destroyed, %llu tiles converted\n",
+                rounds, static_cast<unsigned long long>(tiles));
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int rounds = 2000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rounds = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: teardown_stress [-n rounds]\n");
+            return 2;
+        }
+    }
+
+    testImageConverters(rounds);
+    testTileConverters(rounds);
+    return 0;
+}
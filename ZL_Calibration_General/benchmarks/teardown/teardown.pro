@@ -0,0 +1,26 @@
+TEMPLATE = app
+TARGET = teardown_stress
+
+QT += core gui widgets
+
+CONFIG += console c++20
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../image.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../ImageItem.h \
+    ../../Image_base.h \
+    ../../TiledImageItem.h
+
+INCLUDEPATH += D:\\Boost\\include\\boost-1_79
+LIBS += -LD:/Boost/lib -lboost_system
+
+INCLUDEPATH += D:\\opencv-4.5.1\\build\\include
+LIBS += -LD:\\opencv-4.5.1\\build\\x64\\vc15\\lib
+CONFIG(debug, debug|release): LIBS += -lopencv_world451d
+else: LIBS += -lopencv_world451
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <QtGlobal>
+
+namespace core {
+// Runs the display conversions of every channel on one set of threads sized
+// to the machine, instead of a thread per channel. Each worker serves its own
+// queues first and takes from the others' when they run dry, so a channel
+// with a large sensor keeps one worker busy while the rest serve the other
+// channels.
+//
+// Tasks belong to an owner, a channel. Owners keep at most one task queued or
+// running, as ImageConverter does, which with first-in first-out queues gives
+// every channel its turn however often its frames arrive. High priority
+// tasks, for the channel the user is looking at, go before all normal ones.
+//
+// A conversion lasts milliseconds, so the queues share one lock; it is
+// never held while a task runs.
+class ConversionPool : NonCopyable {
+public:
+    enum class Priority { normal, high };
+
+    struct Statistics {
+        int workers{0};
+        // tasks waiting for a worker
+        int queued{0};
+        // tasks running now
+        int running{0};
+        quint64 completed{0};
+        // tasks run by another worker than the one they were queued on
+        quint64 stolen{0};
+        // time spent running tasks, summed over workers
+        qint64 busyNanoseconds{0};
+        qint64 uptimeNanoseconds{0};
+    };
+
+    explicit ConversionPool(int workers = defaultWorkerCount()) :
+            m_started(Clock::now()) {
+        workers = (std::max)(workers, 1);
+        for (int i = 0; i < workers; ++i) {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+        for (int i = 0; i < workers; ++i) {
+            m_workers[i]->thread = std::thread([this, i] { work(i); });
+        }
+    }
+
+    ~ConversionPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker->thread.join();
+        }
+    }
+
+    // Shared by every channel. Intentionally leaked so channels destroyed
+    // during static destruction can still cancel their tasks.
+    static ConversionPool& instance() {
+        static ConversionPool* pool = new ConversionPool();
+        return *pool;
+    }
+
+    static int defaultWorkerCount() noexcept {
+        return (std::max)(int(std::thread::hardware_concurrency()), 1);
+    }
+
+    // Queues run for owner. From one of this pool's workers it goes on that
+    // worker's queue, where it is likely to find the owner's data in cache,
+    // otherwise on the next worker's in turn.
+    void submit(const void* owner, std::function<void()> run,
+                Priority priority = Priority::normal) {
+        {
+            std::lock_guard lock(m_mutex);
+            const int worker = t_pool == this
+                                       ? t_worker
+                                       : int(m_nextWorker++ % m_workers.size());
+            m_workers[worker]->queues[int(priority)].push_back(
+                    Task{owner, std::move(run)});
+            ++m_queued;
+        }
+        m_wake.notify_one();
+    }
+
+    // Drops owner's queued tasks and waits for its running ones, after which
+    // nothing of owner runs until it submits again. A running task may
+    // submit another before it ends, so the queues are drained again after
+    // each one finishes. Must not be called from one of owner's tasks.
+    void cancel(const void* owner) {
+        std::unique_lock lock(m_mutex);
+        for (;;) {
+            for (auto& worker : m_workers) {
+                for (auto& queue : worker->queues) {
+                    const auto removed = std::remove_if(
+                            queue.begin(), queue.end(), [owner](const Task& t) {
+                                return t.owner == owner;
+                            });
+                    m_queued -= int(queue.end() - removed);
+                    queue.erase(removed, queue.end());
+                }
+            }
+            const bool running = std::any_of(
+                    m_workers.begin(), m_workers.end(),
+                    [owner](const auto& worker) {
+                        return worker->running == owner;
+                    });
+            if (!running) {
+                return;
+            }
+            m_finished.wait(lock);
+        }
+    }
+
+    Statistics statistics() const {
+        std::lock_guard lock(m_mutex);
+        Statistics s;
+        s.workers = int(m_workers.size());
+        s.queued = m_queued;
+        for (const auto& worker : m_workers) {
+            s.running += worker->running != nullptr;
+        }
+        s.completed = m_completed;
+        s.stolen = m_stolen;
+        s.busyNanoseconds = m_busyNanoseconds;
+        s.uptimeNanoseconds = nanosecondsSince(m_started);
+        return s;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        const void* owner{nullptr};
+        std::function<void()> run;
+    };
+
+    struct Worker {
+        // by Priority, high ones taken first
+        std::deque<Task> queues[2];
+        const void* running{nullptr};
+        std::thread thread;
+    };
+
+    static qint64 nanosecondsSince(Clock::time_point start) noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       Clock::now() - start)
+                .count();
+    }
+
+    // High priority tasks anywhere before normal ones, the worker's own
+    // queue before the others'.
+    bool take(int self, Task& task) {
+        const int n = int(m_workers.size());
+        for (int priority = int(Priority::high); priority >= 0; --priority) {
+            for (int i = 0; i < n; ++i) {
+                const int victim = (self + i) % n;
+                auto& queue = m_workers[victim]->queues[priority];
+                if (!queue.empty()) {
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                    --m_queued;
+                    m_stolen += victim != self;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void work(int self) {
+        t_pool = this;
+        t_worker = self;
+        Worker& worker = *m_workers[self];
+
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_wake.wait(lock, [&] {
+                    return m_stopping || take(self, task);
+                });
+                if (m_stopping && !task.run) {
+                    return;
+                }
+                worker.running = task.owner;
+            }
+
+            const auto start = Clock::now();
+            task.run();
+            const qint64 busy = nanosecondsSince(start);
+
+            {
+                std::lock_guard lock(m_mutex);
+                worker.running = nullptr;
+                ++m_completed;
+                m_busyNanoseconds += busy;
+            }
+            m_finished.notify_all();
+        }
+    }
+
+    static inline thread_local const ConversionPool* t_pool = nullptr;
+    static inline thread_local int t_worker = 0;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished;
+    bool m_stopping{false};
+    int m_queued{0};
+    quint64 m_nextWorker{0};
+    quint64 m_completed{0};
+    quint64 m_stolen{0};
+    qint64 m_busyNanoseconds{0};
+    const Clock::time_point m_started;
+};
+} // namespace core
@@ -0,0 +1,97 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+        defined(_M_IX86)
+#define CORE_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Lets a single function use instructions beyond the build's baseline, for
+// kernels that are only reached after a cpuFeatures() check. MSVC accepts
+// every intrinsic without it.
+#if defined(CORE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CORE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CORE_TARGET(isa)
+#endif
+
+namespace core {
+struct CpuFeatures {
+    bool ssse3{false};
+    bool avx2{false};
+    bool avx512bw{false};
+    // per core, 0 when unknown
+    int l2CacheBytes{0};
+};
+
+namespace cpu_detail {
+#ifdef CORE_X86
+inline void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) noexcept {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, int(leaf), int(subleaf));
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = unsigned(r[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XCR0, the register states the OS saves on context switches.
+inline unsigned long long xgetbv0() noexcept {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+inline CpuFeatures detectCpuFeatures() noexcept {
+    CpuFeatures features;
+#ifdef CORE_X86
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    const unsigned maxLeaf = regs[0];
+    if (maxLeaf < 1) {
+        return features;
+    }
+
+    cpuid(0x80000000, 0, regs);
+    if (regs[0] >= 0x80000006) {
+        cpuid(0x80000006, 0, regs);
+        features.l2CacheBytes = int(regs[2] >> 16) * 1024;
+    }
+
+    cpuid(1, 0, regs);
+    features.ssse3 = regs[2] & (1u << 9);
+    const bool osxsave = regs[2] & (1u << 27);
+    if (!osxsave || maxLeaf < 7) {
+        return features;
+    }
+
+    const unsigned long long xcr0 = xgetbv0();
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = ymm && (xcr0 & 0xe0) == 0xe0;
+
+    cpuid(7, 0, regs);
+    features.avx2 = ymm && (regs[1] & (1u << 5));
+    features.avx512bw = zmm && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30));
+#endif
+    return features;
+}
+} // namespace cpu_detail
+
+// Instruction sets usable by this process and cache geometry, probed once.
+inline const CpuFeatures& cpuFeatures() noexcept {
+    static const CpuFeatures features = cpu_detail::detectCpuFeatures();
+    return features;
+}
+} // namespace core
@@ -7,6 +7,7 @@
 #include <QtCore/QMetaType>
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
+#include "trace.hpp"
 
 #ifdef CORE_BUILD_STATIC
 #define CORE_API
@@ -64,7 +65,7 @@ public:
 
     void operator()(QObject* obj) const noexcept {
         if (m_f(obj)) {
-            qDebug() << "do delete.";
+            CORE_TRACE("QObjectOptionalDeleter delete");
             delete obj;
         }
     }
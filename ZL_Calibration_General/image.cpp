@@ -1,6 +1,7 @@
 #pragma once
 
 #include "image_conversion.hpp"
+#include "image_plan.hpp"
 #include "image_private.hpp"
 
 #include "image.h"
@@ -9,22 +10,27 @@
 namespace core {
 Image::Image() noexcept : m_p(nullptr) {}
 
-Image::Image(int width, int height, Format format) :
-        Image(createImagePrivate(width, height, format)) {}
+Image::Image(int width, int height, Format format, Allocation allocation) :
+        Image(createImagePrivate(width, height, format, allocation)) {}
 
 Image::Image(uchar* data, int width, int height, Format format,
              int bytesPerLine, CleanupFunction cleanup) :
         Image(createImagePrivate(data, width, height, format, bytesPerLine,
                                  cleanup)) {}
 
-Image::Image(const QSize& size, Format format) :
-        Image(size.width(), size.height(), format) {}
+Image::Image(const QSize& size, Format format, Allocation allocation) :
+        Image(size.width(), size.height(), format, allocation) {}
 
 Image::Image(uchar* data, const QSize& size, Format format, int bytesPerLine,
              CleanupFunction cleanup) :
         Image(data, size.width(), size.height(), format, bytesPerLine,
               cleanup) {}
 
+Image::Image(uchar* const* planes, const int* bytesPerLine, int width,
+             int height, Format format, CleanupFunction cleanup) :
+        Image(createImagePrivate(planes, bytesPerLine, width, height, format,
+                                 cleanup)) {}
+
 Image::Image(const QImage& image) : Image(createImagePrivate(image)) {}
 
 Image::Image(const QString& fileName, const char* format) : Image(QImage(fileName, format)) {}
@@ -54,6 +60,10 @@ bool Image::isNull() const noexcept {
     return !m_p;
 }
 
+bool Image::isDetached() const noexcept {
+    return m_p && !m_p->isShared();
+}
+
 uchar* Image::bits() noexcept {
     return m_p ? m_p->bits() : nullptr;
 }
@@ -62,6 +72,22 @@ const uchar* Image::bits() const noexcept {
     return m_p ? m_p->bits() : nullptr;
 }
 
+uchar* Image::bits(int plane) noexcept {
+    return m_p && plane >= 0 && plane < m_p->planeCount()
+                   ? m_p->planeBits(plane)
+                   : nullptr;
+}
+
+const uchar* Image::bits(int plane) const noexcept {
+    return m_p && plane >= 0 && plane < m_p->planeCount()
+                   ? static_cast<const ImagePrivate*>(m_p)->planeBits(plane)
+                   : nullptr;
+}
+
+int Image::planeCount() const noexcept {
+    return m_p ? m_p->planeCount() : 0;
+}
+
 qsizetype Image::sizeInBytes() const noexcept {
     return m_p ? m_p->sizeInBytes() : 0;
 }
@@ -86,6 +112,12 @@ int Image::bytesPerLine() const noexcept {
     return m_p ? m_p->bytesPerLine() : 0;
 }
 
+int Image::bytesPerLine(int plane) const noexcept {
+    return m_p && plane >= 0 && plane < m_p->planeCount()
+                   ? m_p->planeBytesPerLine(plane)
+                   : 0;
+}
+
 Image::Format Image::format() const noexcept {
     return m_p ? m_p->format() : invalid;
 }
@@ -102,12 +134,12 @@ Image Image::clone() const {
     return Image(cloneImagePrivate(m_p));
 }
 
+Image Image::view(const QRect& rect) const {
+    return Image(createImageView(m_p, rect));
+}
+
 QImage Image::makePaintable() const {
-#if Q_BYTE_ORDER == Q_BIG_ENDIAN
-    return convertTo(argb32).toQImage();
-#else
-    return convertTo(bgra32).toQImage();
-#endif
+    return convertTo(paintableFormat).toQImage();
 }
 
 bool Image::save(const QString& fileName, const char* format) const {
@@ -129,13 +161,16 @@ bool Image::saveBinary(const QString& fileName) const {
         return file.write(reinterpret_cast<const char*>(bits()),
                           sizeInBytes()) == sizeInBytes();
     } else {
-        const int bpl = depth() * width();
-        const uchar* data = bits();
-        for (int i = 0; i < height(); ++i) {
-            if (file.write(reinterpret_cast<const char*>(data), bpl) != bpl) {
-                return false;
+        for (int plane = 0; plane < planeCount(); ++plane) {
+            const int bpl = planeRowBytes(format(), width(), plane);
+            const uchar* data = bits(plane);
+            for (int i = 0; i < planeHeight(format(), height(), plane); ++i) {
+                if (file.write(reinterpret_cast<const char*>(data), bpl) !=
+                    bpl) {
+                    return false;
+                }
+                data += bytesPerLine(plane);
             }
-            data += bytesPerLine();
         }
         return true;
     }
@@ -146,24 +181,195 @@ Image Image::convertTo(Image::Format format) const {
         return *this;
     }
 
-    auto converter = image_conversion::getConverter(this->format(), format);
-    if (!converter) {
+    Image dst(width(), height(), format, Allocation::aligned);
+    return convertInto(dst) ? dst : Image();
+}
+
+Image Image::convertTo(Format format, const ConversionOptions& options) const {
+    const QSize outputSize = options.outputSize(size());
+    if (isNull() || outputSize.isEmpty()) {
         return Image();
     }
 
-    Image dst(width(), height(), format);
+    if (outputSize == size() && this->format() == format) {
+        return *this;
+    }
+
+    Image dst(outputSize, format, Allocation::aligned);
+    return convertInto(dst, options) ? dst : Image();
+}
+
+bool Image::canConvert(Format from, Format to) noexcept {
+    return image_conversion::canConvert(from, to) ||
+           bool(image_conversion::conversionPlan(from, to));
+}
+
+std::string Image::explainConversion(Format from, Format to) {
+    return image_conversion::explainPlan(from, to);
+}
+
+bool Image::convertInto(Image& dst) const {
+    if (isNull() || dst.isNull() || size() != dst.size()) {
+        return false;
+    }
+    CORE_TRACE_SCOPE("Image::convertInto", int(format()), int(dst.format()));
+
+    if (format() == dst.format()) {
+        copyImagePrivate(*m_p, *dst.m_p);
+        return true;
+    }
+
+    try {
+        auto dstMat = image_conversion::createMat(dst.m_p);
+        if (dstMat.empty()) {
+            return false;
+        }
+
+        auto converter = image_conversion::getConverter(format(), dst.format());
+        if (converter) {
+            converter(*m_p, dstMat);
+            return dstMat.data == dst.bits();
+        }
+
+        const auto& plan =
+                image_conversion::conversionPlan(format(), dst.format());
+        if (!plan) {
+            return false;
+        }
+
+        // one per-thread intermediate per step, kept while the geometry holds
+        using image_conversion::ConversionPlan;
+        thread_local std::array<Image, ConversionPlan::maxSteps> intermediates;
+        const ImagePrivate* in = m_p;
+        for (int i = 0; i < plan.steps; ++i) {
+            ImagePrivate* out = dst.m_p;
+            if (i + 1 < plan.steps) {
+                Image& intermediate = intermediates[i];
+                if (intermediate.size() != size() ||
+                    intermediate.format() != plan.to(i)) {
+                    intermediate =
+                            Image(size(), plan.to(i), Allocation::aligned);
+                }
+                out = intermediate.m_p;
+            }
+            if (!image_conversion::runPlanStep(*in, *out)) {
+                return false;
+            }
+            in = out;
+        }
+        return true;
+    } catch (const cv::Exception& e) {
+        throw ImageConversionError(
+                std::format("Image internal, OpenCV Exception: {}", e.msg));
+    }
+}
+
+bool Image::convertInto(Image& dst, const ConversionOptions& options) const {
+    const QSize outputSize = options.outputSize(size());
+    // bayer sources with other than the default conversion
+    const bool demosaicOptions =
+            image_conversion::isBayerFormat(format()) &&
+            (options.toneLut || options.demosaic != Demosaic::bilinear);
+    const auto demosaic =
+            demosaicOptions ? image_conversion::getDemosaicConverter(
+                                      format(), dst.format())
+                            : nullptr;
+    if (outputSize == size() && !demosaicOptions &&
+        (!options.parallel || format() == dst.format())) {
+        return convertInto(dst);
+    }
+
+    if (isNull() || dst.isNull() || outputSize != dst.size()) {
+        return false;
+    }
+    CORE_TRACE_SCOPE("Image::convertInto options", int(format()),
+                     int(dst.format()));
+
+    auto converter = image_conversion::getConverter(format(), dst.format());
+    const bool rescale = format() == dst.format() &&
+                         image_conversion::isTargetFormat(format());
+    if (!converter && !rescale) {
+        // same format bayer and YUV resample through an 8-bit layout too
+        const auto& plan =
+                image_conversion::conversionPlan(format(), dst.format());
+        if (!plan && format() != dst.format()) {
+            return false;
+        }
+        if (outputSize == size() && !demosaicOptions) {
+            return convertInto(dst);
+        }
+
+        // Chains apply the options up to their last 8-bit layout, the only
+        // formats that resample, and run their remaining steps at the output
+        // size.
+        Format via = bgr24;
+        for (int i = plan.steps - 1; i >= 0; --i) {
+            if (image_conversion::isTargetFormat(plan.from(i))) {
+                via = plan.from(i);
+                break;
+            }
+        }
+        thread_local Image intermediate;
+        if (intermediate.size() != outputSize ||
+            intermediate.format() != via) {
+            intermediate = Image(outputSize, via, Allocation::aligned);
+        }
+        return convertInto(intermediate, options) &&
+               intermediate.convertInto(dst);
+    }
 
     try {
-        auto srcMat = image_conversion::createMat(m_p);
         auto dstMat = image_conversion::createMat(dst.m_p);
+        if (dstMat.empty()) {
+            return false;
+        }
+
+        if (rescale) {
+            cv::resize(image_conversion::createMat(*m_p), dstMat,
+                       dstMat.size(), 0, 0, cv::INTER_AREA);
+            return dstMat.data == dst.bits();
+        }
+
+        auto downscale = image_conversion::getDownscalingConverter(
+                format(), dst.format());
+        if (downscale && width() >= 2 * dst.width() &&
+            height() >= 2 * dst.height()) {
+            downscale(*m_p, dstMat.size(), dstMat, options.parallel,
+                      options.toneLut.get());
+            return dstMat.data == dst.bits();
+        }
 
-        if (srcMat.empty() || dstMat.empty()) {
-            return Image();
+        // 10 to 16 bit bayer defaults to the fused bilinear kernel too
+        const auto fused =
+                demosaic ? demosaic
+                : image_conversion::isHighBitDepthBayer(format())
+                        ? image_conversion::getDemosaicConverter(format(),
+                                                                 dst.format())
+                        : nullptr;
+
+        const bool resample = outputSize != size();
+        cv::Mat& full = resample ? image_conversion::scratch(
+                                           image_conversion::resampleScratch)
+                                 : dstMat;
+        if (fused) {
+            // edge-aware is slow enough to always want every core
+            fused(*m_p, options.demosaic, options.toneLut.get(), full,
+                  options.parallel || options.demosaic == Demosaic::edgeAware);
+        } else if (options.parallel) {
+            full.create(height(), width(), dstMat.type());
+            image_conversion::convertBands(
+                    *m_p,
+                    image_conversion::bandHaloRows(format(), dst.format()),
+                    full, converter);
+        } else {
+            converter(*m_p, full);
         }
 
-        converter(srcMat, this->format(), dstMat);
+        if (resample) {
+            cv::resize(full, dstMat, dstMat.size(), 0, 0, cv::INTER_AREA);
+        }
 
-        return dstMat.data == dst.bits() ? dst : Image();
+        return dstMat.data == dst.bits();
     } catch (const cv::Exception& e) {
         throw ImageConversionError(
                 std::format("Image internal, OpenCV Exception: {}", e.msg));
@@ -8,9 +8,12 @@
 #include <cstddef>
 #include <exception>
 #include <functional>
+#include <memory>
+#include <string>
 #include <type_traits>
 #include <utility>
 
+#include <QtCore/QRect>
 #include <QtCore/QSize>
 #include <QtGui/QImage>
 #include <QObject>
@@ -28,6 +31,7 @@ public:
 };
 
 class ImagePrivate;
+class ToneLut;
 
 class Image {
 public:
@@ -43,6 +47,12 @@ public:
         yuv8_uyvy,
         yuv8_yuy2,
         yuv8_yvyu,
+        // yuv 4:2:0 semi-planar, Y plane then interleaved chroma plane
+        yuv8_nv12,
+        yuv8_nv21,
+        // yuv 4:2:0 planar, Y plane then two quarter size chroma planes
+        yuv8_i420,
+        yuv8_yv12,
         // rgb
         rgb24,
         bgr24,
@@ -80,19 +90,144 @@ public:
         bayer16_rggb,
         bayer16_grbg,
         bayer16_bggr,
-        bayer16_gbrg
+        bayer16_gbrg,
+
+        // MIPI CSI-2 packed
+        // 10 bits, 4 pixels in 5 bytes
+        bayer10p_rggb,
+        bayer10p_grbg,
+        bayer10p_bggr,
+        bayer10p_gbrg,
+
+        // 12 bits, 2 pixels in 3 bytes
+        bayer12p_rggb,
+        bayer12p_grbg,
+        bayer12p_bggr,
+        bayer12p_gbrg,
+
+        // 14 bits, 4 pixels in 7 bytes
+        bayer14p_rggb,
+        bayer14p_grbg,
+        bayer14p_bggr,
+        bayer14p_gbrg
     };
 
     using enum Format;
+    // keep in step with the last enumerator
+    static constexpr int formatCount = static_cast<int>(bayer14p_gbrg) + 1;
+
     using CleanupFunction = void (*)(uchar*) noexcept;
 
+    enum class Allocation {
+        // tightly packed rows, zero-filled
+        zeroed,
+        // tightly packed rows, contents left uninitialized
+        uninitialized,
+        // rows padded to storageAlignment, contents left uninitialized
+        aligned
+    };
+
+    // Display mapping of bayer samples to 8 bits, in place of keeping their
+    // top 8 bits. Built into a ToneLut (image_tone.hpp) for conversions.
+    struct ToneMapping {
+        enum class Curve {
+            linear,
+            // output = input^(1 / gamma)
+            gamma,
+            // ten bits of dynamic range compressed into eight
+            logarithmic
+        };
+
+        enum class Palette { grayscale, jet, hot };
+
+        // Window centre and width, as fractions of the source's full scale.
+        // Samples below the window are black and above it white.
+        double level{0.5};
+        double window{1.0};
+        Curve curve{Curve::linear};
+        double gamma{2.2};
+        // Colors the mapped luma of color targets; grayscale keeps each
+        // channel mapped on its own.
+        Palette palette{Palette::grayscale};
+
+        bool operator==(const ToneMapping&) const = default;
+    };
+
+    // Interpolation of full resolution bayer conversions, fastest first.
+    enum class Demosaic {
+        // every 2x2 quad's samples fill the quad, for thumbnails
+        nearest,
+        // for live view
+        bilinear,
+        // edge directed green, then red and blue from their difference to
+        // green, for color and MTF measurements. Always converts in parallel
+        // row bands.
+        edgeAware
+    };
+
+    struct ConversionOptions {
+        // 1 converts at full resolution. 2 or 4 make a preview: every
+        // binning x binning block of the source becomes one pixel. Bayer
+        // sources collapse their quads directly, without demosaicing; other
+        // sources are converted then area averaged.
+        int binning{1};
+
+        // When not empty, the output is the source scaled down to fit
+        // inside, keeping its aspect ratio, and binning is ignored. Bayer
+        // sources at least twice the output size are demosaiced and area
+        // averaged in the same pass.
+        QSize fitTo;
+
+        // Splits the conversion into row bands converted on OpenCV's worker
+        // threads, for frames too large for one core to convert in time.
+        bool parallel{false};
+
+        // Applied to bayer sources when set, see ToneMapping.
+        std::shared_ptr<const ToneLut> toneLut;
+
+        // Of bayer sources converted at full resolution. Binned and
+        // downscaled ones average whole quads instead.
+        Demosaic demosaic{Demosaic::bilinear};
+
+        // Destination size for a source size, invalid for unsupported
+        // binning factors.
+        QSize outputSize(const QSize& source) const noexcept {
+            if (!fitTo.isEmpty()) {
+                return source.isEmpty()
+                               ? source
+                               : source.scaled(fitTo, Qt::KeepAspectRatio)
+                                         .boundedTo(source)
+                                         .expandedTo(QSize(1, 1));
+            }
+            if (binning != 1 && binning != 2 && binning != 4) {
+                return {};
+            }
+            return {source.width() / binning, source.height() / binning};
+        }
+    };
+
+    // Alignment of every image owned buffer, and the row stride granularity
+    // of Allocation::aligned images.
+    static constexpr int storageAlignment = 64;
+
+    // The format makePaintable() converts to, QImage::Format_RGB32 in memory.
+    static constexpr Format paintableFormat =
+            Q_BYTE_ORDER == Q_BIG_ENDIAN ? argb32 : bgra32;
+
     Image() noexcept;
-    Image(int width, int height, Format format);
-    Image(const QSize& size, Format format);
+    Image(int width, int height, Format format,
+          Allocation allocation = Allocation::zeroed);
+    Image(const QSize& size, Format format,
+          Allocation allocation = Allocation::zeroed);
     Image(uchar* data, int width, int height, Format format,
           int bytesPerLine = -1, CleanupFunction cleanup = nullptr);
     Image(uchar* data, const QSize& size, Format format, int bytesPerLine = -1,
           CleanupFunction cleanup = nullptr);
+    // Wraps separately allocated planes of a multi-plane format, in memory
+    // order (Y, U, V for i420; Y, V, U for yv12). The cleanup function is
+    // called with planes[0].
+    Image(uchar* const* planes, const int* bytesPerLine, int width, int height,
+          Format format, CleanupFunction cleanup = nullptr);
     Image(const QImage& image);
     Image(const QString& fileName, const char* format = nullptr);
 
@@ -107,23 +242,51 @@ public:
 
     uchar* bits() noexcept;
     const uchar* bits() const noexcept;
+    uchar* bits(int plane) noexcept;
+    const uchar* bits(int plane) const noexcept;
+    int planeCount() const noexcept;
     qsizetype sizeInBytes() const noexcept;
     int width() const noexcept;
     int height() const noexcept;
     int depth() const noexcept;
     int bitPlaneCount() const noexcept;
     int bytesPerLine() const noexcept;
+    int bytesPerLine(int plane) const noexcept;
     Format format() const noexcept;
     bool isContinuous() const noexcept;
 
     QImage toQImage() const;
 
     bool isNull() const noexcept;
+    // True when no other Image or QImage shares this image's data, so it can
+    // be written without affecting anyone else.
+    bool isDetached() const noexcept;
 
     Image clone() const;
+    // Zero-copy sub-image sharing this image's storage and stride. The rect is
+    // clipped to the image; bayer views starting on an odd row or column
+    // report the CFA order seen from their own origin.
+    Image view(const QRect& rect) const;
     QImage makePaintable() const;
 
     Image convertTo(Format format) const;
+    Image convertTo(Format format, const ConversionOptions& options) const;
+    // Converts into dst, which keeps its own format, size and stride (it may
+    // be a view). Conversions make no allocations of their own once dst and
+    // the per-thread intermediates exist, so dst can be reused frame after
+    // frame. Pairs without a direct conversion, such as those to bayer, YUV
+    // or packed formats, run the cheapest chain of steps through
+    // intermediate formats. Returns false if the sizes differ or the
+    // conversion is not supported.
+    bool convertInto(Image& dst) const;
+    // As above, with dst sized options.outputSize(size()). Chains apply the
+    // options up to their last 8-bit rgb or gray step.
+    bool convertInto(Image& dst, const ConversionOptions& options) const;
+    // Whether convertTo()/convertInto() support the pair.
+    static bool canConvert(Format from, Format to) noexcept;
+    // The steps convertInto() takes for the pair and their estimated costs,
+    // one per line, for debugging.
+    static std::string explainConversion(Format from, Format to);
 
     bool save(const QString& fileName, const char* format = nullptr) const;
     bool saveBinary(const QString& fileName) const;
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "image.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <QtGlobal>
+
+namespace core {
+// Recycles frame storage between images of the same byte size and format, so
+// steady-state streaming does not hit the heap (and page faults) per frame.
+class ImageBufferPool : NonCopyable {
+public:
+    struct Statistics {
+        quint64 hits{0};
+        quint64 misses{0};
+        quint64 discards{0};
+        qsizetype bytesHeld{0};
+        qsizetype capacity{0};
+    };
+
+    static constexpr qsizetype defaultCapacity = qsizetype(512) << 20;
+
+    explicit ImageBufferPool(qsizetype capacity = defaultCapacity) noexcept :
+            m_capacity(capacity) {}
+
+    ~ImageBufferPool() {
+        clear();
+    }
+
+    // Shared by every ImageData. Intentionally leaked so images that outlive
+    // static destruction can still hand their storage back.
+    static ImageBufferPool& instance() {
+        static ImageBufferPool* pool = new ImageBufferPool();
+        return *pool;
+    }
+
+    // Returns uninitialized storage of at least nBytes bytes, aligned to
+    // Image::storageAlignment.
+    uchar* acquire(qsizetype nBytes, Image::Format format) {
+        {
+            std::lock_guard lock(m_mutex);
+            auto it = m_free.find(Key{nBytes, format});
+            if (it != m_free.end() && !it->second.empty()) {
+                uchar* ptr = it->second.back();
+                it->second.pop_back();
+                m_bytesHeld -= nBytes;
+                ++m_stats.hits;
+                return ptr;
+            }
+            ++m_stats.misses;
+        }
+
+        return allocate(nBytes);
+    }
+
+    void release(uchar* ptr, qsizetype nBytes, Image::Format format) noexcept {
+        if (!ptr) {
+            return;
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_bytesHeld + nBytes <= m_capacity) {
+                try {
+                    m_free[Key{nBytes, format}].push_back(ptr);
+                    m_bytesHeld += nBytes;
+                    return;
+                } catch (...) {
+                    // Bookkeeping failed, fall through and free the block.
+                }
+            }
+            ++m_stats.discards;
+        }
+
+        deallocate(ptr);
+    }
+
+    void setCapacity(qsizetype capacity) {
+        std::unique_lock lock(m_mutex);
+        m_capacity = (std::max)(capacity, qsizetype(0));
+        auto dropped = trimLocked();
+        lock.unlock();
+
+        for (uchar* ptr : dropped) {
+            deallocate(ptr);
+        }
+    }
+
+    qsizetype capacity() const {
+        std::lock_guard lock(m_mutex);
+        return m_capacity;
+    }
+
+    Statistics statistics() const {
+        std::lock_guard lock(m_mutex);
+        Statistics stats = m_stats;
+        stats.bytesHeld = m_bytesHeld;
+        stats.capacity = m_capacity;
+        return stats;
+    }
+
+    void resetStatistics() {
+        std::lock_guard lock(m_mutex);
+        m_stats = Statistics();
+    }
+
+    void clear() {
+        std::unique_lock lock(m_mutex);
+        auto free = std::exchange(m_free, {});
+        m_bytesHeld = 0;
+        lock.unlock();
+
+        for (auto& [key, buffers] : free) {
+            for (uchar* ptr : buffers) {
+                deallocate(ptr);
+            }
+        }
+    }
+
+private:
+    struct Key {
+        qsizetype nBytes;
+        Image::Format format;
+
+        friend bool operator<(const Key& lhs, const Key& rhs) noexcept {
+            return std::pair(lhs.nBytes, lhs.format) <
+                   std::pair(rhs.nBytes, rhs.format);
+        }
+    };
+
+    static uchar* allocate(qsizetype nBytes) {
+        return static_cast<uchar*>(::operator new(
+                static_cast<std::size_t>(nBytes),
+                std::align_val_t(Image::storageAlignment)));
+    }
+
+    static void deallocate(uchar* ptr) noexcept {
+        ::operator delete(ptr, std::align_val_t(Image::storageAlignment));
+    }
+
+    // Drops the largest cached buffers first until the pool fits its cap.
+    std::vector<uchar*> trimLocked() {
+        std::vector<uchar*> dropped;
+        for (auto it = m_free.rbegin();
+             it != m_free.rend() && m_bytesHeld > m_capacity; ++it) {
+            auto& buffers = it->second;
+            while (!buffers.empty() && m_bytesHeld > m_capacity) {
+                dropped.push_back(buffers.back());
+                buffers.pop_back();
+                m_bytesHeld -= it->first.nBytes;
+                ++m_stats.discards;
+            }
+        }
+        return dropped;
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<Key, std::vector<uchar*>> m_free;
+    qsizetype m_bytesHeld{0};
+    qsizetype m_capacity;
+    Statistics m_stats;
+};
+} // namespace core
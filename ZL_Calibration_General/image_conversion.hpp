@@ -1,10 +1,24 @@
 #pragma once
 
+#include "cpu_features.hpp"
+#include "image_demosaic.hpp"
 #include "image_private.hpp"
+#include "image_swizzle.hpp"
+#include "image_tone.hpp"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#ifdef CORE_X86
+#include <immintrin.h>
+#endif
+
 namespace core {
 namespace image_conversion {
 inline int opencvTypeForFormat(Image::Format format) noexcept {
@@ -14,6 +28,24 @@ inline int opencvTypeForFormat(Image::Format format) noexcept {
     case Image::bayer8_bggr:
     case Image::bayer8_gbrg:
     case Image::grayscale8:
+    // the Y plane of 4:2:0 formats
+    case Image::yuv8_nv12:
+    case Image::yuv8_nv21:
+    case Image::yuv8_i420:
+    case Image::yuv8_yv12:
+    // packed formats are addressed as raw bytes
+    case Image::bayer10p_rggb:
+    case Image::bayer10p_grbg:
+    case Image::bayer10p_bggr:
+    case Image::bayer10p_gbrg:
+    case Image::bayer12p_rggb:
+    case Image::bayer12p_grbg:
+    case Image::bayer12p_bggr:
+    case Image::bayer12p_gbrg:
+    case Image::bayer14p_rggb:
+    case Image::bayer14p_grbg:
+    case Image::bayer14p_bggr:
+    case Image::bayer14p_gbrg:
         return CV_8UC1;
     case Image::yuv8_uyvy:
     case Image::yuv8_yuy2:
@@ -50,669 +82,829 @@ inline int opencvTypeForFormat(Image::Format format) noexcept {
 }
 
 inline cv::Mat createMat(ImagePrivate* p) {
-    return p ? cv::Mat(p->height(), p->width(),
-                       opencvTypeForFormat(p->format()), p->bits(),
-                       p->bytesPerLine())
-             : cv::Mat();
-}
+    if (!p) {
+        return cv::Mat();
+    }
 
-inline void cvtColor(const cv::Mat& src, cv::Mat& dst, int code) {
-    cv::cvtColor(src, dst, code);
+    const int cols = isPackedFormat(p->format())
+                             ? p->width() * p->depth() / 8
+                             : p->width();
+    return cv::Mat(p->height(), cols, opencvTypeForFormat(p->format()),
+                   p->bits(), p->bytesPerLine());
+}
+
+// Read only use; cv::Mat has no const data.
+inline cv::Mat createMat(const ImagePrivate& p) {
+    return createMat(const_cast<ImagePrivate*>(&p));
+}
+
+// MIPI CSI-2 RAW10/12/14: each group starts with the 8 most significant bits
+// of every pixel, followed by the remaining low bits of the group packed
+// little-endian, pixel 0 first.
+template <int Bits>
+struct MipiPacking {
+    static_assert(Bits == 10 || Bits == 12 || Bits == 14);
+
+    static constexpr int pixels = Bits == 12 ? 2 : 4;
+    static constexpr int bytes = pixels * Bits / 8;
+    static constexpr int lowBits = Bits - 8;
+};
+
+template <int Bits>
+inline void unpackMipiRowScalar(const uchar* src, ushort* dst, int x,
+                                int width) noexcept {
+    using P = MipiPacking<Bits>;
+    constexpr quint32 lowMask = (1u << P::lowBits) - 1;
+
+    src += x / P::pixels * P::bytes;
+    for (; x < width; x += P::pixels, src += P::bytes) {
+        quint32 low = 0;
+        for (int i = 0; i < P::bytes - P::pixels; ++i) {
+            low |= quint32(src[P::pixels + i]) << (8 * i);
+        }
+        for (int i = 0; i < P::pixels; ++i) {
+            dst[x + i] = ushort((quint32(src[i]) << P::lowBits) |
+                                ((low >> (P::lowBits * i)) & lowMask));
+        }
+    }
 }
 
-inline void cvtColor(const cv::Mat& src, cv::Mat& dst, int code, int ddepth,
-                     double alpha) {
-    cv::Mat tmp;
-    cvtColor(src, tmp, code);
-    tmp.convertTo(dst, ddepth, alpha);
-}
+template <int Bits>
+inline void unpackMipiRowMsb8Scalar(const uchar* src, uchar* dst, int x,
+                                    int width) noexcept {
+    using P = MipiPacking<Bits>;
 
-inline void argbToRGB(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {1, 0, 2, 1, 3, 2};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 3);
+    src += x / P::pixels * P::bytes;
+    for (; x < width; x += P::pixels, src += P::bytes) {
+        for (int i = 0; i < P::pixels; ++i) {
+            dst[x + i] = src[i];
+        }
+    }
 }
 
-inline void argbToBGR(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {1, 2, 2, 1, 3, 0};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 3);
+#ifdef CORE_X86
+// 8 pixels per iteration from 10 (RAW10) or 12 (RAW12) input bytes. Each
+// 16-bit lane is gathered as (msb << 8) | lowByte, then the lane's own low
+// bits are moved to the top of the low byte with a per-lane multiply.
+template <int Bits>
+CORE_TARGET("ssse3")
+inline int unpackMipiRowSsse3(const uchar* src, ushort* dst,
+                              int width) noexcept {
+    static_assert(Bits == 10 || Bits == 12);
+    using P = MipiPacking<Bits>;
+    constexpr int groups = 8 / P::pixels;
+
+    const __m128i gather =
+            Bits == 10 ? _mm_setr_epi8(4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9,
+                                       7, 9, 8)
+                       : _mm_setr_epi8(2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11,
+                                       9, 11, 10);
+    const __m128i scale = Bits == 10
+                                  ? _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1)
+                                  : _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+    const __m128i lowByte = _mm_set1_epi16(0x00ff);
+    const __m128i lowMask = _mm_set1_epi16((1 << P::lowBits) - 1);
+    const __m128i highMask = _mm_set1_epi16(short(0xff << P::lowBits));
+
+    int x = 0;
+    // the 16 byte load reads past the 8 pixels' groups; stop early enough
+    for (; x + 8 + 4 * P::pixels <= width; x += 8, src += groups * P::bytes) {
+        const __m128i in =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i lanes = _mm_shuffle_epi8(in, gather);
+        const __m128i high = _mm_and_si128(
+                _mm_srli_epi16(lanes, 8 - P::lowBits), highMask);
+        const __m128i low = _mm_and_si128(
+                _mm_srli_epi16(
+                        _mm_mullo_epi16(_mm_and_si128(lanes, lowByte), scale),
+                        8 - P::lowBits),
+                lowMask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                         _mm_or_si128(high, low));
+    }
+    return x;
+}
+
+// 12 (RAW10) or 10 (RAW12) pixels per iteration, keeping only the msb bytes.
+template <int Bits>
+CORE_TARGET("ssse3")
+inline int unpackMipiRowMsb8Ssse3(const uchar* src, uchar* dst,
+                                  int width) noexcept {
+    static_assert(Bits == 10 || Bits == 12);
+    using P = MipiPacking<Bits>;
+    constexpr int pixels = Bits == 10 ? 12 : 10;
+    constexpr int bytes = pixels / P::pixels * P::bytes;
+
+    const __m128i gather =
+            Bits == 10 ? _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13,
+                                       -1, -1, -1, -1)
+                       : _mm_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, 12, 13, -1, -1,
+                                       -1, -1, -1, -1);
+
+    int x = 0;
+    // both the load and the 16 byte store run past the group; keep a margin
+    for (; x + 16 + P::pixels <= width; x += pixels, src += bytes) {
+        const __m128i in =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                         _mm_shuffle_epi8(in, gather));
+    }
+    return x;
+}
+#endif
+
+template <int Bits>
+inline void unpackMipiRow(const uchar* src, ushort* dst, int width) noexcept {
+    int x = 0;
+#ifdef CORE_X86
+    if constexpr (Bits != 14) {
+        if (cpuFeatures().ssse3) {
+            x = unpackMipiRowSsse3<Bits>(src, dst, width);
+        }
+    }
+#endif
+    unpackMipiRowScalar<Bits>(src, dst, x, width);
+}
+
+template <int Bits>
+inline void unpackMipiRowMsb8(const uchar* src, uchar* dst,
+                              int width) noexcept {
+    int x = 0;
+#ifdef CORE_X86
+    if constexpr (Bits != 14) {
+        if (cpuFeatures().ssse3) {
+            x = unpackMipiRowMsb8Ssse3<Bits>(src, dst, width);
+        }
+    }
+#endif
+    unpackMipiRowMsb8Scalar<Bits>(src, dst, x, width);
+}
+
+// Unpacks to the matching 16 bits format, keeping every bit.
+inline void unpackMipi(const cv::Mat& src, Image::Format format,
+                       cv::Mat& dst) {
+    const int bits = bitPlaneCountForFormat(format);
+    const int width = src.cols * 8 / bits;
+    dst.create(src.rows, width, CV_16UC1);
+
+    for (int y = 0; y < src.rows; ++y) {
+        const uchar* in = src.ptr<uchar>(y);
+        ushort* out = dst.ptr<ushort>(y);
+        switch (bits) {
+        case 10:
+            unpackMipiRow<10>(in, out, width);
+            break;
+        case 12:
+            unpackMipiRow<12>(in, out, width);
+            break;
+        case 14:
+            unpackMipiRow<14>(in, out, width);
+            break;
+        default:
+            break;
+        }
+    }
 }
 
-inline void argbToRGBA(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {0, 3, 1, 0, 2, 1, 3, 2};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 4);
+// Unpacks to the matching 8 bits bayer format by keeping the msb bytes, the
+// same scale the 16 bits display conversions apply.
+inline void unpackMipiMsb8(const cv::Mat& src, Image::Format format,
+                           cv::Mat& dst) {
+    const int bits = bitPlaneCountForFormat(format);
+    const int width = src.cols * 8 / bits;
+    dst.create(src.rows, width, CV_8UC1);
+
+    for (int y = 0; y < src.rows; ++y) {
+        const uchar* in = src.ptr<uchar>(y);
+        uchar* out = dst.ptr<uchar>(y);
+        switch (bits) {
+        case 10:
+            unpackMipiRowMsb8<10>(in, out, width);
+            break;
+        case 12:
+            unpackMipiRowMsb8<12>(in, out, width);
+            break;
+        case 14:
+            unpackMipiRowMsb8<14>(in, out, width);
+            break;
+        default:
+            break;
+        }
+    }
 }
 
-inline void argbToBGRA(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {0, 3, 1, 2, 2, 1, 3, 0};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 4);
+// Per-thread intermediates, one per nesting level of the converters below.
+// cv::Mat::create() keeps the buffer while the geometry does not change, so
+// converting the same geometry frame after frame stops allocating.
+enum ScratchSlot {
+    unpackScratch,
+    channelScratch,
+    resampleScratch,
+    bandScratch,
+    scratchSlots
+};
+
+inline cv::Mat& scratch(ScratchSlot slot) {
+    thread_local cv::Mat mats[scratchSlots];
+    return mats[slot];
+}
+
+// The 8-bit layouts every source format converts to.
+constexpr bool isTargetFormat(Image::Format format) noexcept {
+    return isSwizzleFormat(format) || format == Image::grayscale8;
+}
+
+// Pixel layout of a target format, the form the row kernels take.
+//
+// Templates spell enumerators through Image::Format: GCC 12 fails to
+// instantiate names brought in by Image's `using enum`.
+template <Image::Format To>
+using LayoutFor = std::conditional_t<
+        To == Image::Format::grayscale8, demosaic::GrayLayout,
+        demosaic::Layout<swizzle_detail::channelPositions(To).channels,
+                         swizzle_detail::channelPositions(To).position[0],
+                         swizzle_detail::channelPositions(To).position[1],
+                         swizzle_detail::channelPositions(To).position[2],
+                         swizzle_detail::channelPositions(To).position[3]>>;
+
+namespace conversion_detail {
+// Column of a target in cvtColorCodes, -1 for other formats.
+constexpr int cvtColorTarget(Image::Format to) noexcept {
+    switch (to) {
+    case Image::rgb24:
+        return 0;
+    case Image::bgr24:
+        return 1;
+    case Image::rgba32:
+        return 2;
+    case Image::bgra32:
+        return 3;
+    case Image::grayscale8:
+        return 4;
+    default:
+        return -1;
+    }
 }
 
-inline void argbToGrayscale(const cv::Mat& src, cv::Mat& dst) {
-    cv::Mat tmp;
-    argbToBGRA(src, tmp);
-    cv::cvtColor(tmp, dst, cv::COLOR_BGRA2GRAY);
+struct CvtColorCodes {
+    Image::Format from;
+    int to[5];
+};
+
+// OpenCV names bayer patterns after the second row's second and third
+// pixels, so rggb is its BayerBG.
+inline constexpr CvtColorCodes cvtColorCodes[] = {
+        {Image::bayer8_rggb,
+         {cv::COLOR_BayerBG2RGB, cv::COLOR_BayerBG2BGR, cv::COLOR_BayerBG2RGBA,
+          cv::COLOR_BayerBG2BGRA, cv::COLOR_BayerBG2GRAY}},
+        {Image::bayer8_grbg,
+         {cv::COLOR_BayerGB2RGB, cv::COLOR_BayerGB2BGR, cv::COLOR_BayerGB2RGBA,
+          cv::COLOR_BayerGB2BGRA, cv::COLOR_BayerGB2GRAY}},
+        {Image::bayer8_bggr,
+         {cv::COLOR_BayerRG2RGB, cv::COLOR_BayerRG2BGR, cv::COLOR_BayerRG2RGBA,
+          cv::COLOR_BayerRG2BGRA, cv::COLOR_BayerRG2GRAY}},
+        {Image::bayer8_gbrg,
+         {cv::COLOR_BayerGR2RGB, cv::COLOR_BayerGR2BGR, cv::COLOR_BayerGR2RGBA,
+          cv::COLOR_BayerGR2BGRA, cv::COLOR_BayerGR2GRAY}},
+        {Image::yuv8_uyvy,
+         {cv::COLOR_YUV2RGB_UYVY, cv::COLOR_YUV2BGR_UYVY,
+          cv::COLOR_YUV2RGBA_UYVY, cv::COLOR_YUV2BGRA_UYVY,
+          cv::COLOR_YUV2GRAY_UYVY}},
+        {Image::yuv8_yuy2,
+         {cv::COLOR_YUV2RGB_YUY2, cv::COLOR_YUV2BGR_YUY2,
+          cv::COLOR_YUV2RGBA_YUY2, cv::COLOR_YUV2BGRA_YUY2,
+          cv::COLOR_YUV2GRAY_YUY2}},
+        {Image::yuv8_yvyu,
+         {cv::COLOR_YUV2RGB_YVYU, cv::COLOR_YUV2BGR_YVYU,
+          cv::COLOR_YUV2RGBA_YVYU, cv::COLOR_YUV2BGRA_YVYU,
+          cv::COLOR_YUV2GRAY_YVYU}},
+        {Image::rgb24, {-1, -1, -1, -1, cv::COLOR_RGB2GRAY}},
+        {Image::bgr24, {-1, -1, -1, -1, cv::COLOR_BGR2GRAY}},
+        {Image::rgba32, {-1, -1, -1, -1, cv::COLOR_RGBA2GRAY}},
+        {Image::bgra32, {-1, -1, -1, -1, cv::COLOR_BGRA2GRAY}},
+        {Image::grayscale8,
+         {cv::COLOR_GRAY2RGB, cv::COLOR_GRAY2BGR, cv::COLOR_GRAY2RGBA,
+          cv::COLOR_GRAY2BGRA, -1}},
+};
+} // namespace conversion_detail
+
+// The cvtColor code converting in one call, -1 when there is none.
+constexpr int cvtColorCode(Image::Format from, Image::Format to) noexcept {
+    const int column = conversion_detail::cvtColorTarget(to);
+    if (column < 0) {
+        return -1;
+    }
+    for (const auto& row : conversion_detail::cvtColorCodes) {
+        if (row.from == from) {
+            return row.to[column];
+        }
+    }
+    return -1;
 }
 
-inline void abgrToRGB(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {1, 2, 2, 1, 3, 0};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 3);
+// Every format converts to the 8-bit targets, and packed formats unpack to
+// their 16 bits counterpart.
+constexpr bool isConvertible(Image::Format from, Image::Format to) noexcept {
+    if (from == Image::invalid) {
+        return false;
+    }
+    if (isPackedFormat(from) && to == unpackedFormatFor(from)) {
+        return true;
+    }
+    return isTargetFormat(to);
 }
 
-inline void abgrToBGR(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {1, 0, 2, 1, 3, 2};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 3);
+template <Image::Format From, Image::Format To>
+inline void swizzle(const cv::Mat& src, cv::Mat& dst) {
+    static const SwizzlePlan plan = swizzlePlan(From, To);
+    swizzle(src, plan, dst);
 }
 
-inline void abgrToRGBA(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {0, 3, 1, 2, 2, 1, 3, 0};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 4);
-}
+// One specialization per single plane (From, To) pair; each step is chosen
+// at compile time.
+template <Image::Format From, Image::Format To>
+inline void convertMat(const cv::Mat& src, cv::Mat& dst) {
+    constexpr int code = cvtColorCode(From, To);
 
-inline void abgrToBGRA(const cv::Mat& src, cv::Mat& dst) {
-    constexpr const int fromTo[] = {0, 3, 1, 0, 2, 1, 3, 2};
-    cv::mixChannels(&src, 1, &dst, 1, &fromTo[0], 4);
+    if constexpr (From == To) {
+        src.copyTo(dst);
+    } else if constexpr (isPackedFormat(From)) {
+        if constexpr (To == unpackedFormatFor(From)) {
+            unpackMipi(src, From, dst);
+        } else {
+            // 8-bit targets only need the msb bytes
+            cv::Mat& bayer = scratch(unpackScratch);
+            unpackMipiMsb8(src, From, bayer);
+            convertMat<bayer8FormatFor(From), To>(bayer, dst);
+        }
+    } else if constexpr (isHighBitDepthBayer(From)) {
+        demosaicTo8<LayoutFor<To>>(src, From, dst);
+    } else if constexpr (isSwizzleFormat(From) && isSwizzleFormat(To)) {
+        swizzle<From, To>(src, dst);
+    } else if constexpr (code >= 0) {
+        cv::cvtColor(src, dst, code);
+    } else if constexpr (To == Image::Format::argb32 ||
+                         To == Image::Format::abgr32) {
+        // cvtColor has no alpha first layouts
+        constexpr Image::Format via = To == Image::Format::argb32
+                                              ? Image::Format::rgba32
+                                              : Image::Format::bgra32;
+        cv::Mat& tmp = scratch(channelScratch);
+        convertMat<From, via>(src, tmp);
+        swizzle<via, To>(tmp, dst);
+    } else {
+        static_assert(To == Image::Format::grayscale8 &&
+                      (From == Image::Format::argb32 ||
+                       From == Image::Format::abgr32));
+        cv::Mat& bgra = scratch(channelScratch);
+        swizzle<From, Image::Format::bgra32>(src, bgra);
+        cv::cvtColor(bgra, dst, cv::COLOR_BGRA2GRAY);
+    }
 }
 
-inline void abgrToGrayscale(const cv::Mat& src, cv::Mat& dst) {
-    cv::Mat tmp;
-    abgrToBGRA(src, tmp);
-    cv::cvtColor(tmp, dst, cv::COLOR_BGRA2GRAY);
+// BT.601 limited range in Q20, the coefficients of OpenCV's YUV to RGB.
+struct Yuv420Coefficients {
+    static constexpr int shift = 20;
+    static constexpr int round = 1 << (shift - 1);
+    static constexpr int y = 1220542;
+    static constexpr int ub = 2116026;
+    static constexpr int ug = -409993;
+    static constexpr int vg = -852492;
+    static constexpr int vr = 1673527;
+};
+
+inline uchar clampToByte(int v) noexcept {
+    return static_cast<uchar>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// Converts the two luma rows sharing one chroma row into the pixel layout L.
+template <class L>
+inline void yuv420ToRgbRows(const uchar* y0, const uchar* y1, const uchar* u,
+                            const uchar* v, int chromaStep, uchar* d0,
+                            uchar* d1, int width) noexcept {
+    using C = Yuv420Coefficients;
+    constexpr int Cn = L::channels;
+
+    for (int x = 0; x < width; x += 2, u += chromaStep, v += chromaStep) {
+        const int cu = int(*u) - 128;
+        const int cv = int(*v) - 128;
+        const int r = C::round + C::vr * cv;
+        const int g = C::round + C::vg * cv + C::ug * cu;
+        const int b = C::round + C::ub * cu;
+
+        const uchar* ys[2] = {y0 + x, y1 + x};
+        uchar* ds[2] = {d0 + x * Cn, d1 + x * Cn};
+        for (int row = 0; row < 2; ++row) {
+            for (int i = 0; i < 2; ++i) {
+                const int luma = (std::max)(int(ys[row][i]) - 16, 0) * C::y;
+                uchar* px = ds[row] + i * Cn;
+                px[L::red] = clampToByte((luma + r) >> C::shift);
+                px[L::green] = clampToByte((luma + g) >> C::shift);
+                px[L::blue] = clampToByte((luma + b) >> C::shift);
+                if constexpr (L::alpha >= 0) {
+                    px[L::alpha] = 255;
+                }
+            }
+        }
+    }
 }
 
-inline void argbToRGB(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                      double alpha) {
-    cv::Mat tmp;
-    argbToRGB(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
+// Reads the chroma planes of any 4:2:0 layout through its plane pointers, so
+// strided, separately allocated and view planes need no repacking.
+template <class L>
+inline void yuv420ToRgb(const ImagePrivate& src, cv::Mat& dst) {
+    dst.create(src.height(), src.width(), CV_MAKETYPE(CV_8U, L::channels));
+
+    const bool semiPlanar = src.planeCount() == 2;
+    const bool vFirst = isChromaVFirst(src.format());
+
+    const uchar* luma = src.planeBits(0);
+    const uchar* first = src.planeBits(1);
+    const uchar* second = semiPlanar ? first + 1 : src.planeBits(2);
+    const uchar* u = vFirst ? second : first;
+    const uchar* v = vFirst ? first : second;
+    const int chromaStep = semiPlanar ? 2 : 1;
+    const int lumaBpl = src.planeBytesPerLine(0);
+    const int uBpl = src.planeBytesPerLine(vFirst && !semiPlanar ? 2 : 1);
+    const int vBpl = src.planeBytesPerLine(vFirst || semiPlanar ? 1 : 2);
+
+    for (int y = 0; y + 1 < dst.rows; y += 2) {
+        yuv420ToRgbRows<L>(
+                luma + qsizetype(y) * lumaBpl, luma + qsizetype(y + 1) * lumaBpl,
+                u + qsizetype(y / 2) * uBpl, v + qsizetype(y / 2) * vBpl,
+                chromaStep, dst.ptr<uchar>(y), dst.ptr<uchar>(y + 1), dst.cols);
+    }
 }
 
-inline void argbToBGR(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                      double alpha) {
-    cv::Mat tmp;
-    argbToBGR(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
-}
+inline void yuv420ToGrayscale(const ImagePrivate& src, cv::Mat& dst) {
+    dst.create(src.height(), src.width(), CV_8UC1);
 
-inline void argbToRGBA(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                       double alpha) {
-    cv::Mat tmp;
-    argbToRGBA(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
+    const uchar* luma = src.planeBits(0);
+    for (int y = 0; y < dst.rows; ++y) {
+        std::copy_n(luma + qsizetype(y) * src.planeBytesPerLine(0), dst.cols,
+                    dst.ptr<uchar>(y));
+    }
 }
 
-inline void argbToBGRA(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                       double alpha) {
-    cv::Mat tmp;
-    argbToBGRA(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
-}
+// Creates dst when it does not already have the target's geometry.
+using Converter = void (*)(const ImagePrivate& src, cv::Mat& dst);
 
-inline void argbToGrayscale(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                            double alpha) {
-    cv::Mat tmp;
-    argbToGrayscale(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
-}
+template <Image::Format From, Image::Format To>
+inline void convert(const ImagePrivate& src, cv::Mat& dst) {
+    static_assert(isConvertible(From, To),
+                  "no conversion between these formats");
 
-inline void abgrToRGB(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                      double alpha) {
-    cv::Mat tmp;
-    abgrToRGB(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
+    if constexpr (isYuv420Format(From)) {
+        if constexpr (To == Image::Format::grayscale8) {
+            yuv420ToGrayscale(src, dst);
+        } else {
+            yuv420ToRgb<LayoutFor<To>>(src, dst);
+        }
+    } else {
+        convertMat<From, To>(createMat(src), dst);
+    }
 }
 
-inline void abgrToBGR(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                      double alpha) {
-    cv::Mat tmp;
-    abgrToBGR(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
+namespace conversion_detail {
+template <Image::Format From, Image::Format To>
+constexpr Converter converterEntry() noexcept {
+    if constexpr (isConvertible(From, To)) {
+        return &convert<From, To>;
+    } else {
+        return nullptr;
+    }
 }
 
-inline void abgrToRGBA(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                       double alpha) {
-    cv::Mat tmp;
-    abgrToRGBA(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
-}
+using ConverterRow = std::array<Converter, Image::formatCount>;
 
-inline void abgrToBGRA(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                       double alpha) {
-    cv::Mat tmp;
-    abgrToBGRA(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
+template <int From, int... To>
+constexpr ConverterRow converterRow(
+        std::integer_sequence<int, To...>) noexcept {
+    return {converterEntry<Image::Format(From), Image::Format(To)>()...};
 }
 
-inline void abgrToGrayscale(const cv::Mat& src, cv::Mat& dst, int ddepth,
-                            double alpha) {
-    cv::Mat tmp;
-    abgrToGrayscale(src, tmp);
-    tmp.convertTo(dst, ddepth, alpha);
+template <int... From>
+constexpr std::array<ConverterRow, Image::formatCount> converterTable(
+        std::integer_sequence<int, From...>) noexcept {
+    return {converterRow<From>(
+            std::make_integer_sequence<int, Image::formatCount>())...};
 }
+} // namespace conversion_detail
 
-inline void toRGB24(const cv::Mat& src, Image::Format format, cv::Mat& dst) {
-    switch (format) {
-    case Image::bayer8_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGB);
-        break;
-    case Image::bayer10_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGB, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGB, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGB, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGB, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGB);
-        break;
-    case Image::bayer10_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGB, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGB, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGB, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGB, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGB);
-        break;
-    case Image::bayer10_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGB, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGB, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGB, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGB, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGB);
-        break;
-    case Image::bayer10_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGB, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGB, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGB, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGB, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::yuv8_uyvy:
-        cvtColor(src, dst, cv::COLOR_YUV2RGB_UYVY);
-        break;
-    case Image::yuv8_yuy2:
-        cvtColor(src, dst, cv::COLOR_YUV2RGB_YUY2);
-        break;
-    case Image::yuv8_yvyu:
-        cvtColor(src, dst, cv::COLOR_YUV2RGB_YVYU);
-        break;
-    case Image::rgb24:
-        src.copyTo(dst);
-        break;
-    case Image::bgr24:
-        cvtColor(src, dst, cv::COLOR_BGR2RGB);
-        break;
-    case Image::rgba32:
-        cvtColor(src, dst, cv::COLOR_RGBA2RGB);
-        break;
-    case Image::bgra32:
-        cvtColor(src, dst, cv::COLOR_BGRA2RGB);
-        break;
-    case Image::argb32:
-        argbToRGB(src, dst);
-        break;
-    case Image::abgr32:
-        abgrToRGB(src, dst);
-        break;
-    case Image::grayscale8:
-        cvtColor(src, dst, cv::COLOR_GRAY2RGB);
-        break;
-    default:
-        break;
-    }
-}
+// [from][to], nullptr for pairs without a conversion.
+inline constexpr auto converters = conversion_detail::converterTable(
+        std::make_integer_sequence<int, Image::formatCount>());
 
-inline void toBGR24(const cv::Mat& src, Image::Format format, cv::Mat& dst) {
-    switch (format) {
-    case Image::bayer8_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGR);
-        break;
-    case Image::bayer10_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGR, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGR, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGR, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGR, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGR);
-        break;
-    case Image::bayer10_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGR, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGR, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGR, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGR, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGR);
-        break;
-    case Image::bayer10_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGR, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGR, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGR, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGR, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGR);
-        break;
-    case Image::bayer10_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGR, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGR, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGR, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGR, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::yuv8_uyvy:
-        cvtColor(src, dst, cv::COLOR_YUV2BGR_UYVY);
-        break;
-    case Image::yuv8_yuy2:
-        cvtColor(src, dst, cv::COLOR_YUV2BGR_YUY2);
-        break;
-    case Image::yuv8_yvyu:
-        cvtColor(src, dst, cv::COLOR_YUV2BGR_YVYU);
-        break;
-    case Image::rgb24:
-        cvtColor(src, dst, cv::COLOR_RGB2BGR);
-        break;
-    case Image::bgr24:
-        src.copyTo(dst);
-        break;
-    case Image::rgba32:
-        cvtColor(src, dst, cv::COLOR_RGBA2BGR);
-        break;
-    case Image::bgra32:
-        cvtColor(src, dst, cv::COLOR_BGRA2BGR);
-        break;
-    case Image::argb32:
-        argbToBGR(src, dst);
-        break;
-    case Image::abgr32:
-        abgrToBGR(src, dst);
-        break;
-    case Image::grayscale8:
-        cvtColor(src, dst, cv::COLOR_GRAY2BGR);
-        break;
-    default:
-        break;
+constexpr Converter getConverter(Image::Format from,
+                                 Image::Format to) noexcept {
+    const int f = static_cast<int>(from);
+    const int t = static_cast<int>(to);
+    if (f < 0 || f >= Image::formatCount || t < 0 ||
+        t >= Image::formatCount) {
+        return nullptr;
+    }
+    return converters[f][t];
+}
+
+// Image::convertInto() copies between identical formats itself.
+constexpr bool canConvert(Image::Format from, Image::Format to) noexcept {
+    return from == to ? from != Image::invalid
+                      : getConverter(from, to) != nullptr;
+}
+
+constexpr bool isBayerFormat(Image::Format format) noexcept {
+    return demosaic::cfaIndex(format) >= 0;
+}
+
+// Row bands for splitting a conversion over OpenCV's worker threads. A band's
+// source and destination rows fit in half the L2 cache so the band is
+// converted while its rows are cached, but bands are never shorter than
+// minBandRows to keep the halo rows of bayer sources a small overhead. Band
+// heights are even, so bayer and 4:2:0 bands start on a whole CFA or chroma
+// row.
+constexpr int minBandRows = 32;
+
+inline int bandRowsFor(qsizetype bytesPerRow) noexcept {
+    const int l2 = cpuFeatures().l2CacheBytes > 0
+                           ? cpuFeatures().l2CacheBytes
+                           : 1024 * 1024;
+    const qsizetype rows = l2 / 2 / (std::max)(bytesPerRow, qsizetype(1));
+    return int(std::clamp(rows, qsizetype(minBandRows), qsizetype(1 << 20))) &
+           ~1;
+}
+
+// Calls body(y0, y1) for consecutive bands of bandRows rows covering
+// [0, rows), on OpenCV's worker threads when parallel.
+template <class Body>
+inline void forEachBand(int rows, int bandRows, bool parallel,
+                        const Body& body) {
+    const int bands = (rows + bandRows - 1) / bandRows;
+    const auto run = [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            body(i * bandRows, (std::min)(rows, (i + 1) * bandRows));
+        }
+    };
+
+    if (parallel && bands > 1) {
+        cv::parallel_for_(cv::Range(0, bands), run, bands);
+    } else {
+        run(cv::Range(0, bands));
     }
 }
 
-inline void toRGBA32(const cv::Mat& src, Image::Format format, cv::Mat& dst) {
-    switch (format) {
-    case Image::bayer8_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGBA);
-        break;
-    case Image::bayer10_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGBA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGBA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGBA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2RGBA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGBA);
-        break;
-    case Image::bayer10_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGBA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGBA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGBA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2RGBA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGBA);
-        break;
-    case Image::bayer10_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGBA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGBA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGBA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2RGBA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGBA);
-        break;
-    case Image::bayer10_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGBA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGBA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGBA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2RGBA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::yuv8_uyvy:
-        cvtColor(src, dst, cv::COLOR_YUV2RGBA_UYVY);
-        break;
-    case Image::yuv8_yuy2:
-        cvtColor(src, dst, cv::COLOR_YUV2RGBA_YUY2);
-        break;
-    case Image::yuv8_yvyu:
-        cvtColor(src, dst, cv::COLOR_YUV2RGBA_YVYU);
-        break;
-    case Image::rgb24:
-        cvtColor(src, dst, cv::COLOR_RGB2RGBA);
-        break;
-    case Image::bgr24:
-        cvtColor(src, dst, cv::COLOR_BGR2RGBA);
-        break;
-    case Image::rgba32:
-        src.copyTo(dst);
-        break;
-    case Image::bgra32:
-        cvtColor(src, dst, cv::COLOR_BGRA2RGBA);
-        break;
-    case Image::argb32:
-        argbToRGBA(src, dst);
-        break;
-    case Image::abgr32:
-        abgrToRGBA(src, dst);
-        break;
-    case Image::grayscale8:
-        cvtColor(src, dst, cv::COLOR_GRAY2RGBA);
-        break;
-    default:
-        break;
+// Rows above and below a band that converting it reads, for converters that
+// only see the band: OpenCV's bilinear demosaic looks one row away, two
+// keep the CFA phase. The fused demosaic kernels read their neighbour rows
+// themselves and take no halo, see convertDemosaiced().
+constexpr int bandHaloRows(Image::Format from, Image::Format to) noexcept {
+    return isBayerFormat(from) && isTargetFormat(to) ? 2 : 0;
+}
+
+// Runs convert(band, rows) over parallel row bands of src into dst, which
+// must already have src's size and the target's type. Each band is a view
+// of src with halo rows (bandHaloRows()) above and below; bands without halo
+// convert straight into their rows of dst, the others convert into a
+// per-thread intermediate and copy their own rows out, which only
+// converters that cannot be given a row range, cvtColor(), need.
+template <class Convert>
+inline void convertBands(const ImagePrivate& src, int halo, cv::Mat& dst,
+                         const Convert& convert) {
+    const int bandRows = bandRowsFor(src.bytesPerLine() +
+                                     qsizetype(dst.cols) * dst.elemSize());
+
+    struct Deref {
+        void operator()(ImagePrivate* p) const noexcept {
+            p->dref();
+        }
+    };
+
+    forEachBand(src.height(), bandRows, true, [&](int y0, int y1) {
+        const int top = (std::max)(y0 - halo, 0);
+        const int bottom = (std::min)(y1 + halo, src.height());
+        std::unique_ptr<ImagePrivate, Deref> band(createImageView(
+                const_cast<ImagePrivate*>(&src),
+                QRect(0, top, src.width(), bottom - top)));
+        band->ref();
+
+        cv::Mat rows = dst.rowRange(y0, y1);
+        if (halo == 0) {
+            convert(*band, rows);
+        } else {
+            cv::Mat& converted = scratch(bandScratch);
+            convert(*band, converted);
+            converted.rowRange(y0 - top, y1 - top).copyTo(rows);
+        }
+    });
+}
+
+// Full bit depth mosaic of a bayer source, unpacking packed formats into
+// the unpackScratch.
+inline cv::Mat fullDepthMosaic(const ImagePrivate& src, bool parallel) {
+    const Image::Format format = src.format();
+    cv::Mat mat = createMat(src);
+    if (!isPackedFormat(format)) {
+        return mat;
     }
-}
 
-inline void toBGRA32(const cv::Mat& src, Image::Format format, cv::Mat& dst) {
-    switch (format) {
-    case Image::bayer8_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGRA);
-        break;
-    case Image::bayer10_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGRA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGRA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGRA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2BGRA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGRA);
-        break;
-    case Image::bayer10_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGRA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGRA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGRA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2BGRA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGRA);
-        break;
-    case Image::bayer10_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGRA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGRA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGRA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2BGRA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGRA);
-        break;
-    case Image::bayer10_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGRA, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGRA, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGRA, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2BGRA, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::yuv8_uyvy:
-        cvtColor(src, dst, cv::COLOR_YUV2BGRA_UYVY);
-        break;
-    case Image::yuv8_yuy2:
-        cvtColor(src, dst, cv::COLOR_YUV2BGRA_YUY2);
-        break;
-    case Image::yuv8_yvyu:
-        cvtColor(src, dst, cv::COLOR_YUV2BGRA_YVYU);
-        break;
-    case Image::rgb24:
-        cvtColor(src, dst, cv::COLOR_RGB2BGRA);
-        break;
-    case Image::bgr24:
-        cvtColor(src, dst, cv::COLOR_BGR2BGRA);
-        break;
-    case Image::rgba32:
-        cvtColor(src, dst, cv::COLOR_RGBA2BGRA);
-        break;
-    case Image::bgra32:
-        src.copyTo(dst);
-        break;
-    case Image::argb32:
-        argbToBGRA(src, dst);
-        break;
-    case Image::abgr32:
-        abgrToBGRA(src, dst);
-        break;
-    case Image::grayscale8:
-        cvtColor(src, dst, cv::COLOR_GRAY2BGRA);
-        break;
-    default:
-        break;
+    cv::Mat& bayer = scratch(unpackScratch);
+    bayer.create(src.height(), src.width(), CV_16UC1);
+    const int bandRows = bandRowsFor(mat.cols + qsizetype(bayer.cols) * 2);
+    forEachBand(mat.rows, bandRows, parallel, [&](int y0, int y1) {
+        cv::Mat rows = bayer.rowRange(y0, y1);
+        unpackMipi(mat.rowRange(y0, y1), format, rows);
+    });
+    return bayer;
+}
+
+// The msb bytes of a packed bayer source as an 8-bit mosaic in the
+// unpackScratch, what its default conversions read; other sources as they
+// are.
+inline cv::Mat msb8Mosaic(const ImagePrivate& src, bool parallel) {
+    const Image::Format format = src.format();
+    cv::Mat mat = createMat(src);
+    if (!isPackedFormat(format)) {
+        return mat;
     }
-}
 
-inline void toARGB32(const cv::Mat& src, Image::Format format, cv::Mat& dst) {
-    cv::Mat rgba;
-    toRGBA32(src, format, rgba);
-    if (!rgba.empty()) {
-        constexpr const int fromTo[] = {0, 1, 1, 2, 2, 3, 3, 0};
-        cv::mixChannels(&rgba, 1, &dst, 1, &fromTo[0], 4);
+    cv::Mat& bayer = scratch(unpackScratch);
+    bayer.create(src.height(), src.width(), CV_8UC1);
+    const int bandRows = bandRowsFor(mat.cols + qsizetype(bayer.cols));
+    forEachBand(mat.rows, bandRows, parallel, [&](int y0, int y1) {
+        cv::Mat rows = bayer.rowRange(y0, y1);
+        unpackMipiMsb8(mat.rowRange(y0, y1), format, rows);
+    });
+    return bayer;
+}
+
+// Bayer to the full size layout of To with the given demosaic, through a
+// ToneLut when there is one. Without one, packed sources keep their msb
+// bytes like their default conversions. parallel splits the destination
+// into row bands; the kernels read the source rows around each band
+// themselves, so every band writes straight into its rows of dst.
+template <Image::Format To>
+inline void convertDemosaiced(const ImagePrivate& src,
+                              Image::Demosaic algorithm, const ToneLut* lut,
+                              cv::Mat& dst, bool parallel) {
+    using L = LayoutFor<To>;
+
+    const Image::Format format = src.format();
+    const cv::Mat mat =
+            lut ? fullDepthMosaic(src, parallel) : msb8Mosaic(src, parallel);
+    dst.create(src.height(), src.width(), CV_MAKETYPE(CV_8U, L::channels));
+    const qsizetype bytesPerRow = qsizetype(mat.cols) * mat.elemSize() +
+                                  qsizetype(dst.cols) * L::channels;
+
+    const int cfa = demosaic::cfaIndex(format);
+    const bool wide = mat.depth() == CV_16U;
+    const auto run = [&](const auto& map) {
+        using M = std::decay_t<decltype(map)>;
+        using Kernel = void (*)(const cv::Mat&, int, const M&, cv::Mat&, int,
+                                int);
+        Kernel kernel;
+        switch (algorithm) {
+        case Image::Demosaic::nearest:
+            kernel = wide ? &demosaic::nearest<L, ushort, M>
+                          : &demosaic::nearest<L, uchar, M>;
+            break;
+        case Image::Demosaic::edgeAware:
+            kernel = wide ? &demosaic::edgeAware<L, ushort, M>
+                          : &demosaic::edgeAware<L, uchar, M>;
+            break;
+        default:
+            kernel = wide ? &demosaic::bilinear<L, ushort, M>
+                          : &demosaic::bilinear<L, uchar, M>;
+            break;
+        }
+        forEachBand(dst.rows, bandRowsFor(bytesPerRow), parallel,
+                    [&](int y0, int y1) {
+                        kernel(mat, cfa, map, dst, y0, y1);
+                    });
+    };
+
+    if (lut) {
+        run(LutMapping(*lut, bitPlaneCountForFormat(format)));
+    } else {
+        run(demosaic::ShiftMapping{wide ? bitPlaneCountForFormat(format) - 8
+                                        : 0});
     }
 }
 
-inline void toABGR32(const cv::Mat& src, Image::Format format, cv::Mat& dst) {
-    cv::Mat bgra;
-    toBGRA32(src, format, bgra);
-    if (!bgra.empty()) {
-        constexpr const int fromTo[] = {0, 1, 1, 2, 2, 3, 3, 0};
-        cv::mixChannels(&bgra, 1, &dst, 1, &fromTo[0], 4);
+using DemosaicConverter = void (*)(const ImagePrivate& src,
+                                   Image::Demosaic algorithm,
+                                   const ToneLut* lut, cv::Mat& dst,
+                                   bool parallel);
+
+constexpr DemosaicConverter getDemosaicConverter(Image::Format from,
+                                                 Image::Format to) noexcept {
+    if (!isBayerFormat(from)) {
+        return nullptr;
     }
-}
 
-inline void toGrayscale8(const cv::Mat& src, Image::Format format,
-                         cv::Mat& dst) {
-    switch (format) {
-    case Image::bayer8_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2GRAY);
-        break;
-    case Image::bayer10_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2GRAY, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2GRAY, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2GRAY, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_rggb:
-        cvtColor(src, dst, cv::COLOR_BayerBG2GRAY, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2GRAY);
-        break;
-    case Image::bayer10_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2GRAY, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2GRAY, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2GRAY, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_grbg:
-        cvtColor(src, dst, cv::COLOR_BayerGB2GRAY, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2GRAY);
-        break;
-    case Image::bayer10_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2GRAY, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2GRAY, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2GRAY, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_bggr:
-        cvtColor(src, dst, cv::COLOR_BayerRG2GRAY, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::bayer8_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2GRAY);
-        break;
-    case Image::bayer10_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2GRAY, CV_8U, 1.0 / (1 << 2));
-        break;
-    case Image::bayer12_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2GRAY, CV_8U, 1.0 / (1 << 4));
-        break;
-    case Image::bayer14_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2GRAY, CV_8U, 1.0 / (1 << 6));
-        break;
-    case Image::bayer16_gbrg:
-        cvtColor(src, dst, cv::COLOR_BayerGR2GRAY, CV_8U, 1.0 / (1 << 8));
-        break;
-    case Image::yuv8_uyvy:
-        cvtColor(src, dst, cv::COLOR_YUV2GRAY_UYVY);
-        break;
-    case Image::yuv8_yuy2:
-        cvtColor(src, dst, cv::COLOR_YUV2GRAY_YUY2);
-        break;
-    case Image::yuv8_yvyu:
-        cvtColor(src, dst, cv::COLOR_YUV2GRAY_YVYU);
-        break;
+    switch (to) {
     case Image::rgb24:
-        cvtColor(src, dst, cv::COLOR_RGB2GRAY);
-        break;
+        return &convertDemosaiced<Image::rgb24>;
     case Image::bgr24:
-        cvtColor(src, dst, cv::COLOR_BGR2GRAY);
-        break;
+        return &convertDemosaiced<Image::bgr24>;
     case Image::rgba32:
-        cvtColor(src, dst, cv::COLOR_RGBA2GRAY);
-        break;
+        return &convertDemosaiced<Image::rgba32>;
     case Image::bgra32:
-        cvtColor(src, dst, cv::COLOR_BGRA2GRAY);
-        break;
+        return &convertDemosaiced<Image::bgra32>;
     case Image::argb32:
-        argbToGrayscale(src, dst);
-        break;
+        return &convertDemosaiced<Image::argb32>;
     case Image::abgr32:
-        abgrToGrayscale(src, dst);
-        break;
+        return &convertDemosaiced<Image::abgr32>;
     case Image::grayscale8:
-        src.copyTo(dst);
-        break;
+        return &convertDemosaiced<Image::grayscale8>;
     default:
-        break;
+        return nullptr;
+    }
+}
+
+// Bayer to a smaller target layout of To in a single pass, straight from
+// the mosaic: exact 2x or 4x reductions bin whole quads, other sizes area
+// average per channel. size must be at most half the source in both
+// directions. Without a ToneLut, packed sources keep their msb bytes like
+// their full resolution conversions. parallel splits both passes into row
+// bands.
+template <Image::Format To>
+inline void convertDownscaled(const ImagePrivate& src, cv::Size size,
+                              cv::Mat& dst, bool parallel,
+                              const ToneLut* lut) {
+    using L = LayoutFor<To>;
+
+    const Image::Format format = src.format();
+    const cv::Mat mat = lut ? fullDepthMosaic(src, parallel)
+                            : msb8Mosaic(src, parallel);
+
+    dst.create(size.height, size.width, CV_MAKETYPE(CV_8U, L::channels));
+
+    const int cfa = demosaic::cfaIndex(format);
+    const auto binnedBy = [&](int factor) {
+        return size.width == src.width() / factor &&
+               size.height == src.height() / factor;
+    };
+    // a destination row reads its share of the source rows
+    const qsizetype bytesPerRow =
+            qsizetype(dst.cols) * L::channels +
+            qsizetype(mat.cols) * mat.elemSize() * mat.rows / dst.rows;
+
+    const auto run = [&](const auto& map) {
+        using M = std::decay_t<decltype(map)>;
+        using Kernel = void (*)(const cv::Mat&, int, const M&, cv::Mat&, int,
+                                int);
+        const bool wide = mat.depth() == CV_16U;
+        Kernel kernel;
+        if (binnedBy(4)) {
+            kernel = wide ? &demosaic::binned<4, L, ushort, M>
+                          : &demosaic::binned<4, L, uchar, M>;
+        } else if (binnedBy(2)) {
+            kernel = wide ? &demosaic::binned<2, L, ushort, M>
+                          : &demosaic::binned<2, L, uchar, M>;
+        } else {
+            kernel = wide ? &demosaic::boxed<L, ushort, M>
+                          : &demosaic::boxed<L, uchar, M>;
+        }
+
+        forEachBand(dst.rows, bandRowsFor(bytesPerRow), parallel,
+                    [&](int y0, int y1) {
+                        kernel(mat, cfa, map, dst, y0, y1);
+                    });
+    };
+
+    if (lut) {
+        run(LutMapping(*lut, bitPlaneCountForFormat(format)));
+    } else {
+        run(demosaic::ShiftMapping{mat.depth() == CV_16U
+                                           ? bitPlaneCountForFormat(format) - 8
+                                           : 0});
     }
 }
 
-using Converter = void (*)(const cv::Mat&, Image::Format, cv::Mat& dst);
+using DownscalingConverter = void (*)(const ImagePrivate& src, cv::Size size,
+                                      cv::Mat& dst, bool parallel,
+                                      const ToneLut* lut);
 
-inline Converter getConverter(Image::Format from, Image::Format to) noexcept {
-    Q_UNUSED(from)
+constexpr DownscalingConverter getDownscalingConverter(
+        Image::Format from, Image::Format to) noexcept {
+    if (!isBayerFormat(from)) {
+        return nullptr;
+    }
 
     switch (to) {
     case Image::rgb24:
-        return &toRGB24;
+        return &convertDownscaled<Image::rgb24>;
     case Image::bgr24:
-        return &toBGR24;
+        return &convertDownscaled<Image::bgr24>;
     case Image::rgba32:
-        return &toRGBA32;
+        return &convertDownscaled<Image::rgba32>;
     case Image::bgra32:
-        return &toBGRA32;
+        return &convertDownscaled<Image::bgra32>;
     case Image::argb32:
-        return &toARGB32;
+        return &convertDownscaled<Image::argb32>;
     case Image::abgr32:
-        return &toABGR32;
+        return &convertDownscaled<Image::abgr32>;
     case Image::grayscale8:
-        return &toGrayscale8;
+        return &convertDownscaled<Image::grayscale8>;
     default:
         return nullptr;
     }
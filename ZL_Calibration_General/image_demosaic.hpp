@@ -0,0 +1,842 @@
+#pragma once
+
+#include "cpu_features.hpp"
+#include "image_private.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <QtGlobal>
+
+#include <opencv2/core.hpp>
+
+#ifdef CORE_X86
+#include <immintrin.h>
+#endif
+
+namespace core {
+namespace image_conversion {
+// Single pass bilinear demosaic of 10 to 16 bits mosaics straight into an
+// 8-bit destination. Every channel is interpolated as four times its value
+// (4c, 2(a + b) or a + b + c + d), so the bit-depth reduction folds into one
+// rounding shift and no 16-bit intermediate image is needed.
+namespace demosaic {
+enum class Site { red, blue, greenOnRed, greenOnBlue };
+
+// Index of the CFA order in the rggb, grbg, bggr, gbrg sequence every bayer
+// depth uses.
+constexpr int cfaIndex(Image::Format format) noexcept {
+    switch (format) {
+    case Image::bayer8_rggb:
+    case Image::bayer10_rggb:
+    case Image::bayer12_rggb:
+    case Image::bayer14_rggb:
+    case Image::bayer16_rggb:
+    case Image::bayer10p_rggb:
+    case Image::bayer12p_rggb:
+    case Image::bayer14p_rggb:
+        return 0;
+    case Image::bayer8_grbg:
+    case Image::bayer10_grbg:
+    case Image::bayer12_grbg:
+    case Image::bayer14_grbg:
+    case Image::bayer16_grbg:
+    case Image::bayer10p_grbg:
+    case Image::bayer12p_grbg:
+    case Image::bayer14p_grbg:
+        return 1;
+    case Image::bayer8_bggr:
+    case Image::bayer10_bggr:
+    case Image::bayer12_bggr:
+    case Image::bayer14_bggr:
+    case Image::bayer16_bggr:
+    case Image::bayer10p_bggr:
+    case Image::bayer12p_bggr:
+    case Image::bayer14p_bggr:
+        return 2;
+    case Image::bayer8_gbrg:
+    case Image::bayer10_gbrg:
+    case Image::bayer12_gbrg:
+    case Image::bayer14_gbrg:
+    case Image::bayer16_gbrg:
+    case Image::bayer10p_gbrg:
+    case Image::bayer12p_gbrg:
+    case Image::bayer14p_gbrg:
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+// Site of column 0 for [cfa][row parity]; column 1 holds the other color of
+// the row.
+inline Site firstSite(int cfa, int rowParity) noexcept {
+    static constexpr Site sites[4][2] = {
+            {Site::red, Site::greenOnBlue},   // rggb
+            {Site::greenOnRed, Site::blue},   // grbg
+            {Site::blue, Site::greenOnRed},   // bggr
+            {Site::greenOnBlue, Site::red},   // gbrg
+    };
+    return sites[cfa][rowParity];
+}
+
+constexpr Site pairedSite(Site site) noexcept {
+    switch (site) {
+    case Site::red:
+        return Site::greenOnRed;
+    case Site::greenOnRed:
+        return Site::red;
+    case Site::blue:
+        return Site::greenOnBlue;
+    default:
+        return Site::blue;
+    }
+}
+
+// How the kernels below reduce channel values, four times a sample mean, to
+// 8 bits. A mapping provides channel() for such values, gray() and
+// palette() for their Q14 luma, falseColor() choosing palette() over
+// channel(), and shifted() for values carrying extra bits.
+//
+// ShiftMapping keeps the top 8 bits: shift is the source bit depth minus 8.
+struct ShiftMapping {
+    int shift;
+
+    ShiftMapping shifted(int bits) const noexcept {
+        return {shift + bits};
+    }
+
+    static constexpr bool falseColor() noexcept {
+        return false;
+    }
+
+    uchar channel(quint32 v4) const noexcept {
+        const int s = shift + 2;
+        return uchar((std::min)((v4 + (1u << (s - 1))) >> s, 255u));
+    }
+
+    uchar gray(quint64 y) const noexcept {
+        const int s = shift + 16;
+        return uchar((std::min)((y + (quint64(1) << (s - 1))) >> s,
+                                quint64(255)));
+    }
+
+    const uchar* palette(quint64) const noexcept {
+        return nullptr;
+    }
+};
+
+// Destination pixel layout: channel byte positions, A < 0 for none and
+// Cn == 1 for luma only.
+template <int Cn, int R, int G, int B, int A>
+struct Layout {
+    static constexpr int channels = Cn;
+    static constexpr int red = R;
+    static constexpr int green = G;
+    static constexpr int blue = B;
+    static constexpr int alpha = A;
+
+    // OpenCV's Bayer2Gray weights, Q14
+    static quint64 luma(quint32 r4, quint32 g4, quint32 b4) noexcept {
+        return quint64(r4) * 4899 + quint64(g4) * 9617 + quint64(b4) * 1868;
+    }
+
+    template <class M>
+    static void store(uchar* px, quint32 r4, quint32 g4, quint32 b4,
+                      const M& map) noexcept {
+        if constexpr (Cn == 1) {
+            px[0] = map.gray(luma(r4, g4, b4));
+        } else {
+            if (map.falseColor()) {
+                const uchar* rgb = map.palette(luma(r4, g4, b4));
+                px[R] = rgb[0];
+                px[G] = rgb[1];
+                px[B] = rgb[2];
+            } else {
+                px[R] = map.channel(r4);
+                px[G] = map.channel(g4);
+                px[B] = map.channel(b4);
+            }
+            if constexpr (A >= 0) {
+                px[A] = 255;
+            }
+        }
+    }
+};
+
+using GrayLayout = Layout<1, 0, 0, 0, -1>;
+using RgbLayout = Layout<3, 0, 1, 2, -1>;
+using BgrLayout = Layout<3, 2, 1, 0, -1>;
+using RgbaLayout = Layout<4, 0, 1, 2, 3>;
+using BgraLayout = Layout<4, 2, 1, 0, 3>;
+using ArgbLayout = Layout<4, 1, 2, 3, 0>;
+using AbgrLayout = Layout<4, 3, 2, 1, 0>;
+
+template <Site S, class L, class T, class M>
+inline void storeSite(uchar* px, const T* up, const T* mid, const T* down,
+                      int l, int x, int r, const M& map) noexcept {
+    const quint32 c = mid[x];
+    const quint32 horizontal = quint32(mid[l]) + mid[r];
+    const quint32 vertical = quint32(up[x]) + down[x];
+
+    if constexpr (S == Site::red || S == Site::blue) {
+        const quint32 cross = horizontal + vertical;
+        const quint32 diagonal =
+                quint32(up[l]) + up[r] + quint32(down[l]) + down[r];
+        if constexpr (S == Site::red) {
+            L::store(px, c * 4, cross, diagonal, map);
+        } else {
+            L::store(px, diagonal, cross, c * 4, map);
+        }
+    } else if constexpr (S == Site::greenOnRed) {
+        L::store(px, horizontal * 2, c * 4, vertical * 2, map);
+    } else {
+        L::store(px, vertical * 2, c * 4, horizontal * 2, map);
+    }
+}
+
+// Calls store.template operator()<S>(l, x, r) for every column x of a row
+// whose column 0 is site S0, l and r being the columns beside x. Borders
+// mirror without repeating the edge (reflect 101), which keeps every
+// neighbour on the CFA color it stands in for.
+template <Site S0, class Store>
+inline void forEachSite(int width, const Store& store) noexcept {
+    constexpr Site S1 = pairedSite(S0);
+
+    if (width < 2) {
+        if (width == 1) {
+            store.template operator()<S0>(0, 0, 0);
+        }
+        return;
+    }
+
+    store.template operator()<S0>(1, 0, 1);
+
+    int x = 1;
+    for (; x + 2 < width; x += 2) {
+        store.template operator()<S1>(x - 1, x, x + 1);
+        store.template operator()<S0>(x, x + 1, x + 2);
+    }
+    for (; x < width; ++x) {
+        const int r = x + 1 < width ? x + 1 : x - 1;
+        if (x & 1) {
+            store.template operator()<S1>(x - 1, x, r);
+        } else {
+            store.template operator()<S0>(x - 1, x, r);
+        }
+    }
+}
+
+template <class Store>
+inline void forEachSite(Site first, int width, const Store& store) noexcept {
+    switch (first) {
+    case Site::red:
+        forEachSite<Site::red>(width, store);
+        break;
+    case Site::blue:
+        forEachSite<Site::blue>(width, store);
+        break;
+    case Site::greenOnRed:
+        forEachSite<Site::greenOnRed>(width, store);
+        break;
+    case Site::greenOnBlue:
+        forEachSite<Site::greenOnBlue>(width, store);
+        break;
+    }
+}
+
+// Row or column i mirrored into [0, n) as forEachSite() mirrors columns.
+inline int reflect(int i, int n) noexcept {
+    if (n < 2) {
+        return 0;
+    }
+    if (i < 0) {
+        i = -i;
+    } else if (i >= n) {
+        i = 2 * n - 2 - i;
+    }
+    return std::clamp(i, 0, n - 1);
+}
+
+template <class L, class T, class M>
+inline void bilinearRow(Site first, const T* up, const T* mid, const T* down,
+                        uchar* dst, int width, const M& map) noexcept {
+    forEachSite(first, width, [&]<Site S>(int l, int x, int r) {
+        storeSite<S, L>(dst + x * L::channels, up, mid, down, l, x, r, map);
+    });
+}
+
+// Demosaics destination rows [y0, y1). Source rows outside the range are
+// read as needed, so disjoint ranges can run concurrently.
+template <class L, class T, class M>
+inline void bilinear(const cv::Mat& src, int cfa, const M& map, cv::Mat& dst,
+                     int y0, int y1) noexcept {
+    const int height = src.rows;
+    for (int y = y0; y < y1; ++y) {
+        bilinearRow<L>(firstSite(cfa, y & 1),
+                       src.ptr<T>(reflect(y - 1, height)), src.ptr<T>(y),
+                       src.ptr<T>(reflect(y + 1, height)),
+                       dst.ptr<uchar>(y), src.cols, map);
+    }
+}
+
+// Position of the red sample in a 2x2 quad per CFA; blue sits diagonal to
+// it and green fills the other two.
+constexpr int redColumn(int cfa) noexcept {
+    return cfa == 1 || cfa == 2 ? 1 : 0;
+}
+
+constexpr int redRow(int cfa) noexcept {
+    return cfa == 2 || cfa == 3 ? 1 : 0;
+}
+
+#ifdef CORE_X86
+namespace simd_detail {
+// pshufb masks spreading the red, green and blue bytes of 16 quads over the
+// 32 pixels of layout L, 16 output bytes at a time; alpha holds L's opaque
+// alpha bytes, the same in every 16 when there are four channels.
+template <class L>
+struct QuadShuffles {
+    static constexpr int chunks = 2 * L::channels;
+
+    uchar masks[chunks][3][16]{};
+    uchar alpha[16]{};
+
+    constexpr QuadShuffles() {
+        for (int k = 0; k < chunks; ++k) {
+            for (int j = 0; j < 16; ++j) {
+                const int i = 16 * k + j;
+                const int position = i % L::channels;
+                const int quad = i / L::channels / 2;
+                for (int c = 0; c < 3; ++c) {
+                    masks[k][c][j] = 0x80;
+                }
+                if (position == L::red) {
+                    masks[k][0][j] = uchar(quad);
+                } else if (position == L::green) {
+                    masks[k][1][j] = uchar(quad);
+                } else if (position == L::blue) {
+                    masks[k][2][j] = uchar(quad);
+                }
+            }
+        }
+        for (int j = 0; j < 16; ++j) {
+            alpha[j] = j % L::channels == L::alpha ? 0xff : 0;
+        }
+    }
+};
+
+template <class L>
+inline constexpr QuadShuffles<L> quadShuffles{};
+
+CORE_TARGET("ssse3")
+inline __m128i load128(const void* p) noexcept {
+    return _mm_loadu_si128(static_cast<const __m128i*>(p));
+}
+
+// Even and odd columns of 32 8-bit samples, the left and right samples of
+// 16 quads.
+CORE_TARGET("ssse3")
+inline void splitColumns(const uchar* line, __m128i& even,
+                         __m128i& odd) noexcept {
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    const __m128i a = load128(line);
+    const __m128i b = load128(line + 16);
+    even = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+    odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+// Even and odd columns of 16 16-bit samples, 8 quads.
+CORE_TARGET("ssse3")
+inline void splitColumns(const ushort* line, __m128i& even,
+                         __m128i& odd) noexcept {
+    const __m128i split = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7,
+                                        10, 11, 14, 15);
+    const __m128i a = _mm_shuffle_epi8(load128(line), split);
+    const __m128i b = _mm_shuffle_epi8(load128(line + 8), split);
+    even = _mm_unpacklo_epi64(a, b);
+    odd = _mm_unpackhi_epi64(a, b);
+}
+
+// ShiftMapping::channel() of four times v for shift >= 2, without
+// overflowing 16 bits: (v + 2^(shift - 1)) >> shift equals
+// ((v >> (shift - 1)) + 1) >> 1. Saturated to 8 bits by the pack after.
+CORE_TARGET("ssse3")
+inline __m128i shiftTo8(__m128i v, __m128i shift) noexcept {
+    return _mm_avg_epu16(_mm_srl_epi16(v, shift), _mm_setzero_si128());
+}
+
+// Red, green and blue bytes of the 16 quads starting at column x of 8-bit
+// lines; ShiftMapping{0} keeps red and blue and rounds the green mean.
+CORE_TARGET("ssse3")
+inline void nearestQuads(const uchar* redLine, const uchar* blueLine, int rx,
+                         int, __m128i rgb[3]) noexcept {
+    __m128i redEven, redOdd, blueEven, blueOdd;
+    splitColumns(redLine, redEven, redOdd);
+    splitColumns(blueLine, blueEven, blueOdd);
+    rgb[0] = rx ? redOdd : redEven;
+    rgb[1] = _mm_avg_epu8(rx ? redEven : redOdd, rx ? blueOdd : blueEven);
+    rgb[2] = rx ? blueEven : blueOdd;
+}
+
+// The same for 16-bit lines and ShiftMapping{shift}, shift >= 2. The green
+// mean is taken rounding down, which the shift's rounding then matches.
+CORE_TARGET("ssse3")
+inline void nearestQuads(const ushort* redLine, const ushort* blueLine,
+                         int rx, int shift, __m128i rgb[3]) noexcept {
+    const __m128i count = _mm_cvtsi32_si128(shift - 1);
+    __m128i halves[2][3];
+    for (int h = 0; h < 2; ++h) {
+        __m128i redEven, redOdd, blueEven, blueOdd;
+        splitColumns(redLine + 16 * h, redEven, redOdd);
+        splitColumns(blueLine + 16 * h, blueEven, blueOdd);
+        const __m128i a = rx ? redEven : redOdd;
+        const __m128i b = rx ? blueOdd : blueEven;
+        const __m128i green = _mm_add_epi16(
+                _mm_and_si128(a, b), _mm_srli_epi16(_mm_xor_si128(a, b), 1));
+        halves[h][0] = shiftTo8(rx ? redOdd : redEven, count);
+        halves[h][1] = shiftTo8(green, count);
+        halves[h][2] = shiftTo8(rx ? blueEven : blueOdd, count);
+    }
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = _mm_packus_epi16(halves[0][c], halves[1][c]);
+    }
+}
+
+// nearest() of a row, 32 pixels per iteration from 32 samples of each of
+// the quad's lines; returns the columns done, the rest are left to the
+// scalar loop. L has three or four channels.
+template <class L, class T>
+CORE_TARGET("ssse3")
+inline int nearestRowSsse3(const T* redLine, const T* blueLine, int rx,
+                           int shift, uchar* dst, int width) noexcept {
+    constexpr const QuadShuffles<L>& shuffles = quadShuffles<L>;
+    const __m128i alpha = load128(shuffles.alpha);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i rgb[3];
+        nearestQuads(redLine + x, blueLine + x, rx, shift, rgb);
+        uchar* px = dst + x * L::channels;
+        for (int k = 0; k < shuffles.chunks; ++k) {
+            __m128i out = alpha;
+            for (int c = 0; c < 3; ++c) {
+                out = _mm_or_si128(out,
+                                   _mm_shuffle_epi8(
+                                           rgb[c],
+                                           load128(shuffles.masks[k][c])));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(px + 16 * k), out);
+        }
+    }
+    return x;
+}
+
+// Eight columns widened to 32 bits.
+CORE_TARGET("avx2")
+inline __m256i load8x32(const uchar* p) noexcept {
+    return _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+CORE_TARGET("avx2")
+inline __m256i load8x32(const ushort* p) noexcept {
+    return _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// greenRow() of columns [2, x), eight per iteration, x being returned; the
+// columns within two of either border are left to the scalar loop.
+// greenParity is the parity of the row's green columns.
+template <class T>
+CORE_TARGET("avx2")
+inline int greenRowAvx2(const T* up2, const T* up, const T* mid,
+                        const T* down, const T* down2, int width,
+                        int greenParity, qint32* green) noexcept {
+    const __m256i top =
+            _mm256_set1_epi32(4 * qint32(std::numeric_limits<T>::max()));
+    const __m256i zero = _mm256_setzero_si256();
+    // x stays even, so the green lanes are the same every iteration
+    const __m256i greenLanes =
+            greenParity ? _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1)
+                        : _mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+
+    int x = 2;
+    for (; x + 10 <= width; x += 8) {
+        const __m256i c = load8x32(mid + x);
+        const __m256i left = load8x32(mid + x - 1);
+        const __m256i right = load8x32(mid + x + 1);
+        const __m256i u = load8x32(up + x);
+        const __m256i d = load8x32(down + x);
+        const __m256i twice = _mm256_slli_epi32(c, 1);
+
+        const __m256i laplacianH = _mm256_sub_epi32(
+                _mm256_sub_epi32(twice, load8x32(mid + x - 2)),
+                load8x32(mid + x + 2));
+        const __m256i laplacianV = _mm256_sub_epi32(
+                _mm256_sub_epi32(twice, load8x32(up2 + x)),
+                load8x32(down2 + x));
+        const __m256i gradientH =
+                _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(left, right)),
+                                 _mm256_abs_epi32(laplacianH));
+        const __m256i gradientV =
+                _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(u, d)),
+                                 _mm256_abs_epi32(laplacianV));
+        const __m256i h = _mm256_add_epi32(
+                _mm256_slli_epi32(_mm256_add_epi32(left, right), 1),
+                laplacianH);
+        const __m256i v = _mm256_add_epi32(
+                _mm256_slli_epi32(_mm256_add_epi32(u, d), 1), laplacianV);
+
+        // (h + v) / 2 rounding toward zero, as the scalar division does
+        const __m256i sum = _mm256_add_epi32(h, v);
+        __m256i g = _mm256_srai_epi32(
+                _mm256_add_epi32(sum, _mm256_srli_epi32(sum, 31)), 1);
+        g = _mm256_blendv_epi8(g, h, _mm256_cmpgt_epi32(gradientV, gradientH));
+        g = _mm256_blendv_epi8(g, v, _mm256_cmpgt_epi32(gradientH, gradientV));
+        g = _mm256_min_epi32(_mm256_max_epi32(g, zero), top);
+        g = _mm256_blendv_epi8(g, _mm256_slli_epi32(c, 2), greenLanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(green + x), g);
+    }
+    return x;
+}
+} // namespace simd_detail
+#endif
+
+// Every pixel of a 2x2 quad takes the quad's red and blue samples and the
+// mean of its two greens, for thumbnails. Quads start on even rows and
+// columns; an odd last row or column borrows the one before it. Rows of
+// three and four channel layouts through a ShiftMapping take 32 pixels at
+// a time with SSSE3 when features has it.
+template <class L, class T, class M>
+inline void nearestUsing(const CpuFeatures& features, const cv::Mat& src,
+                         int cfa, const M& map, cv::Mat& dst, int y0,
+                         int y1) noexcept {
+    constexpr int cn = L::channels;
+    const int rx = redColumn(cfa);
+    const int ry = redRow(cfa);
+    const int width = src.cols;
+
+    bool vectorized = false;
+    if constexpr (std::is_same_v<M, ShiftMapping> && cn > 1) {
+        vectorized = features.ssse3 &&
+                     (sizeof(T) == 1 ? map.shift == 0 : map.shift >= 2);
+    }
+#ifndef CORE_X86
+    Q_UNUSED(features);
+#endif
+
+    for (int y = y0; y < y1; ++y) {
+        const int top = y & ~1;
+        const T* lines[2] = {src.ptr<T>(top),
+                             src.ptr<T>(reflect(top + 1, src.rows))};
+        const T* redLine = lines[ry];
+        const T* blueLine = lines[ry ^ 1];
+        uchar* px = dst.ptr<uchar>(y);
+
+        const auto quad = [&](int x, int right) {
+            const int columns[2] = {x, right};
+            const quint32 r = redLine[columns[rx]];
+            const quint32 b = blueLine[columns[rx ^ 1]];
+            const quint32 g =
+                    quint32(redLine[columns[rx ^ 1]]) + blueLine[columns[rx]];
+            L::store(px + x * cn, r * 4, g * 2, b * 4, map);
+        };
+
+        int x = 0;
+#ifdef CORE_X86
+        if constexpr (std::is_same_v<M, ShiftMapping> && cn > 1) {
+            if (vectorized) {
+                x = simd_detail::nearestRowSsse3<L>(redLine, blueLine, rx,
+                                                    map.shift, px, width);
+            }
+        }
+#endif
+        for (; x + 1 < width; x += 2) {
+            quad(x, x + 1);
+            std::copy_n(px + x * cn, cn, px + (x + 1) * cn);
+        }
+        if (x < width) {
+            quad(x, reflect(x + 1, width));
+        }
+    }
+}
+
+template <class L, class T, class M>
+inline void nearest(const cv::Mat& src, int cfa, const M& map, cv::Mat& dst,
+                    int y0, int y1) noexcept {
+    nearestUsing<L, T>(cpuFeatures(), src, cfa, map, dst, y0, y1);
+}
+
+// Per-thread rows of the green plane edgeAware() interpolates.
+inline std::vector<qint32>& greenRows() {
+    thread_local std::vector<qint32> rows;
+    return rows;
+}
+
+// Four times the green at red or blue site x, l and r being the columns
+// beside it: interpolated along the direction with the smaller gradient,
+// corrected by the Laplacian of the site's own color (Hamilton-Adams).
+template <class T>
+inline qint32 interpolatedGreen(const T* up2, const T* up, const T* mid,
+                                const T* down, const T* down2, int width,
+                                int l, int x, int r) noexcept {
+    constexpr qint32 top = 4 * qint32(std::numeric_limits<T>::max());
+    const qint32 c = mid[x];
+    const qint32 laplacianH =
+            2 * c - mid[reflect(x - 2, width)] - mid[reflect(x + 2, width)];
+    const qint32 laplacianV = 2 * c - up2[x] - down2[x];
+    const qint32 gradientH =
+            std::abs(qint32(mid[l]) - mid[r]) + std::abs(laplacianH);
+    const qint32 gradientV =
+            std::abs(qint32(up[x]) - down[x]) + std::abs(laplacianV);
+    const qint32 h = 2 * (qint32(mid[l]) + mid[r]) + laplacianH;
+    const qint32 v = 2 * (qint32(up[x]) + down[x]) + laplacianV;
+    const qint32 g = gradientH < gradientV   ? h
+                     : gradientV < gradientH ? v
+                                             : (h + v) / 2;
+    return std::clamp(g, 0, top);
+}
+
+// Four times the green of every column of row y. Green sites keep their
+// sample, red and blue sites take interpolatedGreen(). With AVX2 in
+// features all but the two columns at either border go eight at a time.
+template <class T>
+inline void greenRow(const CpuFeatures& features, const cv::Mat& src,
+                     int cfa, int y, qint32* green) noexcept {
+    const int height = src.rows;
+    const int width = src.cols;
+    const T* up2 = src.ptr<T>(reflect(y - 2, height));
+    const T* up = src.ptr<T>(reflect(y - 1, height));
+    const T* mid = src.ptr<T>(y);
+    const T* down = src.ptr<T>(reflect(y + 1, height));
+    const T* down2 = src.ptr<T>(reflect(y + 2, height));
+    const Site first = firstSite(cfa, y & 1);
+
+#ifdef CORE_X86
+    if (features.avx2) {
+        const int greenParity =
+                first == Site::greenOnRed || first == Site::greenOnBlue ? 0
+                                                                        : 1;
+        const auto column = [&](int x) {
+            green[x] = (x & 1) == greenParity
+                               ? 4 * qint32(mid[x])
+                               : interpolatedGreen(up2, up, mid, down, down2,
+                                                   width, reflect(x - 1, width),
+                                                   x, reflect(x + 1, width));
+        };
+        const int end = simd_detail::greenRowAvx2(up2, up, mid, down, down2,
+                                                  width, greenParity, green);
+        for (int x = 0; x < (std::min)(2, width); ++x) {
+            column(x);
+        }
+        for (int x = end; x < width; ++x) {
+            column(x);
+        }
+        return;
+    }
+#else
+    Q_UNUSED(features);
+#endif
+
+    forEachSite(first, width, [&]<Site S>(int l, int x, int r) {
+        if constexpr (S == Site::greenOnRed || S == Site::greenOnBlue) {
+            green[x] = 4 * qint32(mid[x]);
+        } else {
+            green[x] = interpolatedGreen(up2, up, mid, down, down2, width, l,
+                                         x, r);
+        }
+    });
+}
+
+// Edge-aware demosaic of destination rows [y0, y1): greenRow() makes the
+// green plane, then red and blue interpolate their difference to green
+// over their nearest samples, following the edges the green plane kept.
+// For color and MTF measurements. Reads up to three rows outside the
+// range, so disjoint ranges can run concurrently.
+template <class L, class T, class M>
+inline void edgeAwareUsing(const CpuFeatures& features, const cv::Mat& src,
+                           int cfa, const M& map, cv::Mat& dst, int y0,
+                           int y1) {
+    constexpr qint32 top = 4 * qint32(std::numeric_limits<T>::max());
+    const int height = src.rows;
+    const int width = src.cols;
+
+    // rows y - 1, y and y + 1 of the green plane, each in slot row % 3
+    std::vector<qint32>& rows = greenRows();
+    rows.resize(3 * std::size_t(width));
+    int cached[3] = {-1, -1, -1};
+    const auto greenOf = [&](int row) -> const qint32* {
+        qint32* green = rows.data() + std::size_t(row % 3) * width;
+        if (cached[row % 3] != row) {
+            greenRow<T>(features, src, cfa, row, green);
+            cached[row % 3] = row;
+        }
+        return green;
+    };
+
+    for (int y = y0; y < y1; ++y) {
+        const int above = reflect(y - 1, height);
+        const int below = reflect(y + 1, height);
+        const qint32* gUp = greenOf(above);
+        const qint32* gMid = greenOf(y);
+        const qint32* gDown = greenOf(below);
+        const T* up = src.ptr<T>(above);
+        const T* mid = src.ptr<T>(y);
+        const T* down = src.ptr<T>(below);
+        uchar* px = dst.ptr<uchar>(y);
+
+        // four times a sample less the green there
+        const auto diff = [](const T* raw, const qint32* green, int i) {
+            return 4 * qint32(raw[i]) - green[i];
+        };
+
+        forEachSite(firstSite(cfa, y & 1), width,
+                    [&]<Site S>(int l, int x, int r) {
+            const qint32 g = gMid[x];
+            qint32 red;
+            qint32 blue;
+            if constexpr (S == Site::red || S == Site::blue) {
+                const qint32 own = 4 * qint32(mid[x]);
+                const qint32 other =
+                        g + (diff(up, gUp, l) + diff(up, gUp, r) +
+                             diff(down, gDown, l) + diff(down, gDown, r)) /
+                                    4;
+                red = S == Site::red ? own : other;
+                blue = S == Site::red ? other : own;
+            } else {
+                const qint32 horizontal =
+                        g + (diff(mid, gMid, l) + diff(mid, gMid, r)) / 2;
+                const qint32 vertical =
+                        g + (diff(up, gUp, x) + diff(down, gDown, x)) / 2;
+                red = S == Site::greenOnRed ? horizontal : vertical;
+                blue = S == Site::greenOnRed ? vertical : horizontal;
+            }
+            L::store(px + x * L::channels, quint32(std::clamp(red, 0, top)),
+                     quint32(g), quint32(std::clamp(blue, 0, top)), map);
+        });
+    }
+}
+
+template <class L, class T, class M>
+inline void edgeAware(const cv::Mat& src, int cfa, const M& map, cv::Mat& dst,
+                      int y0, int y1) {
+    edgeAwareUsing<L, T>(cpuFeatures(), src, cfa, map, dst, y0, y1);
+}
+
+// Collapses each Factor x Factor block of sensor pixels into one pixel of
+// destination rows [y0, y1), without interpolation: every channel is the
+// mean of its own samples in the block. Trailing rows and columns that do
+// not fill a block are dropped.
+template <int Factor, class L, class T, class M>
+inline void binned(const cv::Mat& src, int cfa, const M& map, cv::Mat& dst,
+                   int y0, int y1) noexcept {
+    static_assert(Factor == 2 || Factor == 4);
+    constexpr int cn = L::channels;
+    // r and b sum Factor^2 / 4 samples and g twice as many; scaled as below
+    // they are four times the mean for 2x2 and sixteen times for 4x4.
+    const M blockMap = map.shifted(Factor == 4 ? 2 : 0);
+
+    const int rx = redColumn(cfa);
+    const int ry = redRow(cfa);
+    const int bx = rx ^ 1;
+    const int by = ry ^ 1;
+
+    for (int y = y0; y < y1; ++y) {
+        const T* rows[Factor];
+        for (int i = 0; i < Factor; ++i) {
+            rows[i] = src.ptr<T>(y * Factor + i);
+        }
+
+        uchar* px = dst.ptr<uchar>(y);
+        for (int x = 0; x < dst.cols; ++x, px += cn) {
+            quint32 r = 0;
+            quint32 g = 0;
+            quint32 b = 0;
+            for (int qy = 0; qy < Factor; qy += 2) {
+                const T* redLine = rows[qy + ry];
+                const T* blueLine = rows[qy + by];
+                for (int qx = x * Factor; qx < (x + 1) * Factor; qx += 2) {
+                    r += redLine[qx + rx];
+                    b += blueLine[qx + bx];
+                    g += quint32(redLine[qx + bx]) + blueLine[qx + rx];
+                }
+            }
+            L::store(px, r * 4, g * 2, b * 4, blockMap);
+        }
+    }
+}
+
+// Area averages a mosaic at least twice as large as dst in both directions
+// into destination rows [y0, y1). Each destination pixel covers a box of
+// source pixels (box edges are rounded down to whole pixels), and every
+// channel is the mean of its own samples in the box.
+template <class L, class T, class M>
+inline void boxed(const cv::Mat& src, int cfa, const M& map, cv::Mat& dst,
+                  int y0, int y1) noexcept {
+    constexpr int cn = L::channels;
+    // color (0 red, 1 green, 2 blue) by row parity then column parity
+    static constexpr int colors[4][2][2] = {
+            {{0, 1}, {1, 2}}, // rggb
+            {{1, 0}, {2, 1}}, // grbg
+            {{2, 1}, {1, 0}}, // bggr
+            {{1, 2}, {0, 1}}, // gbrg
+    };
+
+    const auto boxEdge = [](int i, int from, int to) {
+        return int(qint64(i) * from / to);
+    };
+
+    for (int y = y0; y < y1; ++y) {
+        const int top = boxEdge(y, src.rows, dst.rows);
+        const int bottom = boxEdge(y + 1, src.rows, dst.rows);
+
+        uchar* px = dst.ptr<uchar>(y);
+        int left = 0;
+        for (int x = 0; x < dst.cols; ++x, px += cn) {
+            const int right = boxEdge(x + 1, src.cols, dst.cols);
+
+            quint64 sums[3] = {0, 0, 0};
+            quint32 counts[3] = {0, 0, 0};
+            for (int sy = top; sy < bottom; ++sy) {
+                const T* line = src.ptr<T>(sy);
+                const int* rowColors = colors[cfa][sy & 1];
+                for (int sx = left; sx < right; ++sx) {
+                    const int c = rowColors[sx & 1];
+                    sums[c] += line[sx];
+                    ++counts[c];
+                }
+            }
+
+            quint32 fourTimesMean[3];
+            for (int c = 0; c < 3; ++c) {
+                fourTimesMean[c] =
+                        quint32((sums[c] * 4 + counts[c] / 2) / counts[c]);
+            }
+            L::store(px, fourTimesMean[0], fourTimesMean[1], fourTimesMean[2],
+                     map);
+            left = right;
+        }
+    }
+}
+} // namespace demosaic
+
+// Demosaics a 10 to 16 bits bayer image into an 8-bit layout in one pass.
+template <class L>
+inline void demosaicTo8(const cv::Mat& src, Image::Format format,
+                        cv::Mat& dst) {
+    dst.create(src.rows, src.cols, CV_MAKETYPE(CV_8U, L::channels));
+    const demosaic::ShiftMapping map{bitPlaneCountForFormat(format) - 8};
+    demosaic::bilinear<L, ushort>(src, demosaic::cfaIndex(format), map, dst,
+                                  0, src.rows);
+}
+
+// Whether a format takes the fused path above.
+constexpr bool isHighBitDepthBayer(Image::Format format) noexcept {
+    return format >= Image::bayer10_rggb && format <= Image::bayer16_gbrg;
+}
+} // namespace image_conversion
+} // namespace core
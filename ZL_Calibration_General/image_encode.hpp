@@ -0,0 +1,280 @@
+#pragma once
+
+#include "image_conversion.hpp"
+
+namespace core {
+namespace image_conversion {
+// Kernels writing the formats the converters only read: bayer mosaics, other
+// bayer bit depths, MIPI packed rows and YUV. They write every plane of dst,
+// which has src's size, through its own strides. The conversion planner
+// (image_plan.hpp) chains them after the converters.
+using Encoder = void (*)(const ImagePrivate& src, ImagePrivate& dst);
+
+namespace encode_detail {
+template <class T>
+inline const T* row(const ImagePrivate& p, int y, int plane = 0) noexcept {
+    return reinterpret_cast<const T*>(
+            p.planeBits(plane) + qsizetype(y) * p.planeBytesPerLine(plane));
+}
+
+template <class T>
+inline T* row(ImagePrivate& p, int y, int plane = 0) noexcept {
+    return reinterpret_cast<T*>(p.planeBits(plane) +
+                                qsizetype(y) * p.planeBytesPerLine(plane));
+}
+
+// Offset of a site's color in the pixel layout L.
+template <class L>
+constexpr int channelOf(demosaic::Site site) noexcept {
+    return site == demosaic::Site::red    ? L::red
+           : site == demosaic::Site::blue ? L::blue
+                                          : L::green;
+}
+
+// BT.601 limited range in Q8, the inverse of Yuv420Coefficients.
+inline uchar lumaOf(int r, int g, int b) noexcept {
+    return uchar(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// From sums of n samples of each channel, n a power of two given as its log.
+inline uchar chromaUOf(int r, int g, int b, int log2n) noexcept {
+    return uchar(((-38 * r - 74 * g + 112 * b + (128 << log2n)) >>
+                  (8 + log2n)) +
+                 128);
+}
+
+inline uchar chromaVOf(int r, int g, int b, int log2n) noexcept {
+    return uchar(((112 * r - 94 * g - 18 * b + (128 << log2n)) >>
+                  (8 + log2n)) +
+                 128);
+}
+} // namespace encode_detail
+
+// Samples each pixel's CFA color out of the 8-bit layout L.
+template <class L>
+inline void mosaic(const ImagePrivate& src, ImagePrivate& dst) {
+    using namespace encode_detail;
+    const int cfa = demosaic::cfaIndex(dst.format());
+
+    for (int y = 0; y < src.height(); ++y) {
+        const demosaic::Site first = demosaic::firstSite(cfa, y & 1);
+        const int offsets[2] = {channelOf<L>(first),
+                                channelOf<L>(demosaic::pairedSite(first))};
+        const uchar* in = row<uchar>(src, y);
+        uchar* out = row<uchar>(dst, y);
+        for (int x = 0; x < src.width(); ++x) {
+            out[x] = in[x * L::channels + offsets[x & 1]];
+        }
+    }
+}
+
+// Between the bit depths of one CFA order. Deeper targets repeat the top
+// bits in the new low bits, so full scale stays full scale; shallower ones
+// keep the top bits, as unpackMipiMsb8() does.
+template <class In, class Out>
+inline void rescaleBayer(const ImagePrivate& src, ImagePrivate& dst) {
+    using namespace encode_detail;
+    const int from = src.bitPlaneCount();
+    const int to = dst.bitPlaneCount();
+
+    for (int y = 0; y < src.height(); ++y) {
+        const In* in = row<In>(src, y);
+        Out* out = row<Out>(dst, y);
+        if (to > from) {
+            const int up = to - from;
+            const int down = from - up;
+            for (int x = 0; x < src.width(); ++x) {
+                const quint32 v = in[x];
+                out[x] = Out((v << up) | (v >> down));
+            }
+        } else {
+            const int down = from - to;
+            for (int x = 0; x < src.width(); ++x) {
+                out[x] = Out(quint32(in[x]) >> down);
+            }
+        }
+    }
+}
+
+// The inverse of unpackMipiRowScalar().
+template <int Bits>
+inline void packMipi(const ImagePrivate& src, ImagePrivate& dst) {
+    using namespace encode_detail;
+    using P = MipiPacking<Bits>;
+    constexpr quint32 lowMask = (1u << P::lowBits) - 1;
+
+    for (int y = 0; y < src.height(); ++y) {
+        const ushort* in = row<ushort>(src, y);
+        uchar* out = row<uchar>(dst, y);
+        for (int x = 0; x < src.width(); x += P::pixels, out += P::bytes) {
+            quint32 low = 0;
+            for (int i = 0; i < P::pixels; ++i) {
+                out[i] = uchar(in[x + i] >> P::lowBits);
+                low |= (in[x + i] & lowMask) << (P::lowBits * i);
+            }
+            for (int i = 0; i < P::bytes - P::pixels; ++i) {
+                out[P::pixels + i] = uchar(low >> (8 * i));
+            }
+        }
+    }
+}
+
+// Each pair of pixels shares the average of their chroma. Odd widths pair
+// the last pixel with itself.
+template <class L>
+inline void encodeYuv422(const ImagePrivate& src, ImagePrivate& dst) {
+    using namespace encode_detail;
+    // byte offsets of Y0, U, Y1, V in a macropixel
+    const int order[3][4] = {{1, 0, 3, 2}, {0, 1, 2, 3}, {0, 3, 2, 1}};
+    const int* o = order[dst.format() == Image::Format::yuv8_uyvy   ? 0
+                         : dst.format() == Image::Format::yuv8_yuy2 ? 1
+                                                                    : 2];
+    const int last = src.width() - 1;
+
+    for (int y = 0; y < src.height(); ++y) {
+        const uchar* in = row<uchar>(src, y);
+        uchar* out = row<uchar>(dst, y);
+        for (int x = 0; x <= last; x += 2, out += 4) {
+            const uchar* p0 = in + x * L::channels;
+            const uchar* p1 = in + (std::min)(x + 1, last) * L::channels;
+            const int r = p0[L::red] + p1[L::red];
+            const int g = p0[L::green] + p1[L::green];
+            const int b = p0[L::blue] + p1[L::blue];
+            out[o[0]] = lumaOf(p0[L::red], p0[L::green], p0[L::blue]);
+            out[o[1]] = chromaUOf(r, g, b, 1);
+            out[o[2]] = lumaOf(p1[L::red], p1[L::green], p1[L::blue]);
+            out[o[3]] = chromaVOf(r, g, b, 1);
+        }
+    }
+}
+
+// Each 2x2 block shares the average of its chroma, written through the
+// plane pointers as yuv420ToRgb() reads them.
+template <class L>
+inline void encodeYuv420(const ImagePrivate& src, ImagePrivate& dst) {
+    using namespace encode_detail;
+    const bool semiPlanar = dst.planeCount() == 2;
+    const bool vFirst = isChromaVFirst(dst.format());
+    const int chromaStep = semiPlanar ? 2 : 1;
+    const int uPlane = semiPlanar || !vFirst ? 1 : 2;
+    const int vPlane = semiPlanar || vFirst ? 1 : 2;
+    const int uOffset = semiPlanar && vFirst ? 1 : 0;
+    const int vOffset = semiPlanar && !vFirst ? 1 : 0;
+
+    for (int y = 0; y + 1 < src.height(); y += 2) {
+        const uchar* in[2] = {row<uchar>(src, y), row<uchar>(src, y + 1)};
+        uchar* luma[2] = {row<uchar>(dst, y), row<uchar>(dst, y + 1)};
+        uchar* u = row<uchar>(dst, y / 2, uPlane) + uOffset;
+        uchar* v = row<uchar>(dst, y / 2, vPlane) + vOffset;
+        for (int x = 0; x + 1 < src.width();
+             x += 2, u += chromaStep, v += chromaStep) {
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for (int i = 0; i < 2; ++i) {
+                for (int j = 0; j < 2; ++j) {
+                    const uchar* px = in[i] + (x + j) * L::channels;
+                    luma[i][x + j] = lumaOf(px[L::red], px[L::green],
+                                            px[L::blue]);
+                    r += px[L::red];
+                    g += px[L::green];
+                    b += px[L::blue];
+                }
+            }
+            *u = chromaUOf(r, g, b, 2);
+            *v = chromaVOf(r, g, b, 2);
+        }
+    }
+}
+
+constexpr bool isYuv422Format(Image::Format format) noexcept {
+    return format == Image::yuv8_uyvy || format == Image::yuv8_yuy2 ||
+           format == Image::yuv8_yvyu;
+}
+
+// Bit depth of an unpacked bayer format's samples, 0 for other formats.
+constexpr int bayerDepth(Image::Format format) noexcept {
+    return isBayerFormat(format) && !isPackedFormat(format)
+                   ? bitPlaneCountForFormat(format)
+                   : 0;
+}
+
+// 8-bit layouts mosaic to 8-bit bayer and encode to YUV, bayer formats
+// change depth within their CFA order and unpacked ones pack.
+constexpr bool isEncodable(Image::Format from, Image::Format to) noexcept {
+    if (from == to) {
+        return false;
+    }
+    if (isTargetFormat(from)) {
+        return (bayerDepth(to) == 8) || isYuv422Format(to) ||
+               isYuv420Format(to);
+    }
+    if (bayerDepth(from) == 0 ||
+        demosaic::cfaIndex(from) != demosaic::cfaIndex(to)) {
+        return false;
+    }
+    return bayerDepth(to) != 0 ||
+           (isPackedFormat(to) && unpackedFormatFor(to) == from);
+}
+
+template <Image::Format From, Image::Format To>
+inline void encode(const ImagePrivate& src, ImagePrivate& dst) {
+    static_assert(isEncodable(From, To), "no encoding between these formats");
+
+    if constexpr (isTargetFormat(From)) {
+        if constexpr (isYuv422Format(To)) {
+            encodeYuv422<LayoutFor<From>>(src, dst);
+        } else if constexpr (isYuv420Format(To)) {
+            encodeYuv420<LayoutFor<From>>(src, dst);
+        } else {
+            mosaic<LayoutFor<From>>(src, dst);
+        }
+    } else if constexpr (isPackedFormat(To)) {
+        packMipi<bitPlaneCountForFormat(To)>(src, dst);
+    } else {
+        using In = std::conditional_t<bayerDepth(From) == 8, uchar, ushort>;
+        using Out = std::conditional_t<bayerDepth(To) == 8, uchar, ushort>;
+        rescaleBayer<In, Out>(src, dst);
+    }
+}
+
+namespace conversion_detail {
+template <Image::Format From, Image::Format To>
+constexpr Encoder encoderEntry() noexcept {
+    if constexpr (isEncodable(From, To)) {
+        return &encode<From, To>;
+    } else {
+        return nullptr;
+    }
+}
+
+using EncoderRow = std::array<Encoder, Image::formatCount>;
+
+template <int From, int... To>
+constexpr EncoderRow encoderRow(std::integer_sequence<int, To...>) noexcept {
+    return {encoderEntry<Image::Format(From), Image::Format(To)>()...};
+}
+
+template <int... From>
+constexpr std::array<EncoderRow, Image::formatCount> encoderTable(
+        std::integer_sequence<int, From...>) noexcept {
+    return {encoderRow<From>(
+            std::make_integer_sequence<int, Image::formatCount>())...};
+}
+} // namespace conversion_detail
+
+// [from][to], nullptr for pairs without an encoder.
+inline constexpr auto encoders = conversion_detail::encoderTable(
+        std::make_integer_sequence<int, Image::formatCount>());
+
+constexpr Encoder getEncoder(Image::Format from, Image::Format to) noexcept {
+    const int f = static_cast<int>(from);
+    const int t = static_cast<int>(to);
+    if (f < 0 || f >= Image::formatCount || t < 0 ||
+        t >= Image::formatCount) {
+        return nullptr;
+    }
+    return encoders[f][t];
+}
+} // namespace image_conversion
+} // namespace core
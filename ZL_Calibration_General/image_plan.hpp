@@ -0,0 +1,316 @@
+#pragma once
+
+#include "image_conversion.hpp"
+#include "image_encode.hpp"
+
+#include <array>
+#include <format>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace core {
+namespace image_conversion {
+// Chains of converters and encoders for the pairs neither covers alone, such
+// as bayer12 to NV12 (demosaic, then encode) or bayer12 to bayer10p (rescale,
+// then pack). Every direct step has an estimated cost per pixel and every
+// intermediate image the cost of writing and reading it back; each pair gets
+// the cheapest chain that loses no color or bit depth both ends have, found
+// once for all pairs on first use.
+//
+// Costs are relative, a swizzle between two 32-bit layouts being 0.5,
+// estimated from each kernel's work per pixel. They only need to rank the
+// candidate chains; benchmarks/conversion measures the real timings.
+namespace plan_detail {
+constexpr double swizzleCost = 0.5;
+constexpr double unpackCost = 1.0;
+constexpr double msb8UnpackCost = 0.5;
+constexpr double highBitDepthDemosaicCost = 4.0;
+constexpr double bayer8DemosaicCost = 2.5;
+constexpr double yuv422DecodeCost = 1.5;
+constexpr double yuv420DecodeCost = 2.0;
+constexpr double lumaCost = 1.0;
+constexpr double grayExpandCost = 0.75;
+constexpr double planeCopyCost = 0.25;
+constexpr double mosaicCost = 0.75;
+constexpr double rescaleCost = 0.5;
+constexpr double packCost = 1.0;
+constexpr double yuvEncodeCost = 1.5;
+// per byte of an intermediate pixel, written once and read once
+constexpr double intermediateByteCost = 0.125;
+} // namespace plan_detail
+
+// Estimated cost of the converter for the pair, following convertMat()'s
+// choice of kernel; 0 when there is none.
+constexpr double converterCost(Image::Format from, Image::Format to) noexcept {
+    using namespace plan_detail;
+    if (from == to || !isConvertible(from, to)) {
+        return 0;
+    }
+    if (isPackedFormat(from)) {
+        return to == unpackedFormatFor(from)
+                       ? unpackCost
+                       : msb8UnpackCost +
+                                 converterCost(bayer8FormatFor(from), to);
+    }
+    if (isHighBitDepthBayer(from)) {
+        return highBitDepthDemosaicCost;
+    }
+    if (isYuv420Format(from)) {
+        return to == Image::grayscale8 ? planeCopyCost : yuv420DecodeCost;
+    }
+    if (isSwizzleFormat(from) && isSwizzleFormat(to)) {
+        return swizzleCost;
+    }
+    if (cvtColorCode(from, to) >= 0) {
+        if (isBayerFormat(from)) {
+            return bayer8DemosaicCost;
+        }
+        if (isYuv422Format(from)) {
+            return yuv422DecodeCost;
+        }
+        return from == Image::grayscale8 ? grayExpandCost : lumaCost;
+    }
+    if (to == Image::argb32 || to == Image::abgr32) {
+        const Image::Format via =
+                to == Image::argb32 ? Image::rgba32 : Image::bgra32;
+        return converterCost(from, via) + swizzleCost;
+    }
+    // alpha first layouts to grayscale, through bgra32
+    return swizzleCost + lumaCost;
+}
+
+// Estimated cost of the encoder for the pair; 0 when there is none.
+constexpr double encoderCost(Image::Format from, Image::Format to) noexcept {
+    using namespace plan_detail;
+    if (!isEncodable(from, to)) {
+        return 0;
+    }
+    if (isTargetFormat(from)) {
+        return bayerDepth(to) == 8 ? mosaicCost : yuvEncodeCost;
+    }
+    return isPackedFormat(to) ? packCost : rescaleCost;
+}
+
+constexpr double intermediateCost(Image::Format format) noexcept {
+    return depthForFormat(format) / 8.0 * plan_detail::intermediateByteCost;
+}
+
+struct ConversionPlan {
+    static constexpr int maxSteps = 6;
+
+    // The source format, every intermediate, then the destination format.
+    std::array<Image::Format, maxSteps + 1> formats{};
+    int steps{0};
+    double cost{0};
+
+    explicit operator bool() const noexcept {
+        return steps > 0;
+    }
+
+    Image::Format from(int step) const noexcept {
+        return formats[step];
+    }
+
+    Image::Format to(int step) const noexcept {
+        return formats[step + 1];
+    }
+};
+
+namespace plan_detail {
+// Converters and encoders never cover the same pair; 0 when neither does.
+constexpr double stepCost(Image::Format from, Image::Format to) noexcept {
+    const double converter = converterCost(from, to);
+    return converter > 0 ? converter : encoderCost(from, to);
+}
+
+// What a format keeps of an image: bits per sample, and color resolution
+// from 0 (grayscale) through 1 (bayer mosaics and 4:2:0) and 2 (4:2:2) to 3
+// (a color per pixel).
+struct Fidelity {
+    int depth;
+    int color;
+};
+
+constexpr Fidelity fidelityOf(Image::Format format) noexcept {
+    if (isBayerFormat(format)) {
+        return {bitPlaneCountForFormat(format), 1};
+    }
+    if (isYuv420Format(format)) {
+        return {8, 1};
+    }
+    if (isYuv422Format(format)) {
+        return {8, 2};
+    }
+    return {8, format == Image::grayscale8 ? 0 : 3};
+}
+
+constexpr int fidelityDepths[] = {16, 14, 12, 10, 8};
+constexpr int fidelityDepthCount = int(std::size(fidelityDepths));
+
+// Cheapest routes from one source through formats keeping at least a given
+// fidelity. Dense Dijkstra, there are few formats. Reaching a format costs
+// its step plus writing it as an intermediate.
+struct Routes {
+    static constexpr double unreached = 1e300;
+
+    std::array<double, Image::formatCount> cost;
+    std::array<int, Image::formatCount> previous;
+
+    Routes(Image::Format from, Fidelity floor) noexcept {
+        constexpr int n = Image::formatCount;
+        std::array<bool, n> done{};
+        cost.fill(unreached);
+        previous.fill(-1);
+        cost[int(from)] = 0;
+
+        for (;;) {
+            int f = -1;
+            for (int i = 1; i < n; ++i) {
+                if (!done[i] && cost[i] < unreached &&
+                    (f < 0 || cost[i] < cost[f])) {
+                    f = i;
+                }
+            }
+            if (f < 0) {
+                break;
+            }
+            done[f] = true;
+            for (int t = 1; t < n; ++t) {
+                const auto to = Image::Format(t);
+                const Fidelity kept = fidelityOf(to);
+                const double step = stepCost(Image::Format(f), to);
+                const double total = cost[f] + step + intermediateCost(to);
+                if (step > 0 && kept.depth >= floor.depth &&
+                    kept.color >= floor.color && total < cost[t]) {
+                    cost[t] = total;
+                    previous[t] = f;
+                }
+            }
+        }
+    }
+};
+
+// Plans from one source to every destination. A plan keeps the fidelity
+// both ends share; when no chain does, it gives up bit depth before color.
+inline void planFrom(Image::Format from, ConversionPlan* plans) {
+    std::array<std::optional<Routes>, 4 * fidelityDepthCount> routes;
+    const Fidelity source = fidelityOf(from);
+
+    for (int t = 1; t < Image::formatCount; ++t) {
+        const auto to = Image::Format(t);
+        if (to == from) {
+            continue;
+        }
+        const Fidelity target = fidelityOf(to);
+        const int color = (std::min)(source.color, target.color);
+        const int depth = (std::min)(source.depth, target.depth);
+        const int firstDepth = int(
+                std::find(std::begin(fidelityDepths), std::end(fidelityDepths),
+                          depth) -
+                std::begin(fidelityDepths));
+
+        for (int c = color; c >= 0 && !plans[t]; --c) {
+            for (int d = firstDepth; d < fidelityDepthCount && !plans[t]; ++d) {
+                auto& route = routes[c * fidelityDepthCount + d];
+                if (!route) {
+                    route.emplace(from, Fidelity{fidelityDepths[d], c});
+                }
+                if (route->previous[t] < 0) {
+                    continue;
+                }
+
+                std::array<Image::Format, Image::formatCount> reversed;
+                int length = 0;
+                for (int f = t; f >= 0; f = route->previous[f]) {
+                    reversed[length++] = Image::Format(f);
+                }
+                if (length - 1 > ConversionPlan::maxSteps) {
+                    continue;
+                }
+
+                ConversionPlan& plan = plans[t];
+                plan.steps = length - 1;
+                std::reverse_copy(reversed.begin(), reversed.begin() + length,
+                                  plan.formats.begin());
+                plan.cost = route->cost[t] - intermediateCost(to);
+            }
+        }
+    }
+}
+
+inline std::vector<ConversionPlan> planAll() {
+    std::vector<ConversionPlan> plans(Image::formatCount * Image::formatCount);
+    for (int f = 1; f < Image::formatCount; ++f) {
+        planFrom(Image::Format(f), &plans[f * Image::formatCount]);
+    }
+    return plans;
+}
+} // namespace plan_detail
+
+// The cheapest chain for the pair, empty when the formats are the same or
+// nothing reaches the destination. Plans for every pair are made together on
+// the first call and kept.
+inline const ConversionPlan& conversionPlan(Image::Format from,
+                                            Image::Format to) {
+    static const std::vector<ConversionPlan> plans = plan_detail::planAll();
+    static const ConversionPlan none;
+    const int f = static_cast<int>(from);
+    const int t = static_cast<int>(to);
+    if (f < 0 || f >= Image::formatCount || t < 0 ||
+        t >= Image::formatCount) {
+        return none;
+    }
+    return plans[f * Image::formatCount + t];
+}
+
+// Runs one step of a plan, src and dst having its formats and one size.
+inline bool runPlanStep(const ImagePrivate& src, ImagePrivate& dst) {
+    if (const Converter converter =
+                getConverter(src.format(), dst.format())) {
+        cv::Mat mat = createMat(&dst);
+        if (mat.empty()) {
+            return false;
+        }
+        converter(src, mat);
+        return mat.data == dst.bits();
+    }
+
+    const Encoder encoder = getEncoder(src.format(), dst.format());
+    if (!encoder) {
+        return false;
+    }
+    encoder(src, dst);
+    return true;
+}
+
+// One line per step with its estimated cost, for logs and debugging.
+inline std::string explainPlan(Image::Format from, Image::Format to) {
+    const ConversionPlan& plan = conversionPlan(from, to);
+    if (from == to) {
+        return std::format("{}: same format, copied", formatName(from));
+    }
+    if (!plan) {
+        return std::format("{} > {}: no conversion", formatName(from),
+                           formatName(to));
+    }
+
+    std::string text = std::format("{} > {}: {} step(s), cost {:.2f}/pixel",
+                                   formatName(from), formatName(to),
+                                   plan.steps, plan.cost);
+    for (int i = 0; i < plan.steps; ++i) {
+        const Image::Format a = plan.from(i);
+        const Image::Format b = plan.to(i);
+        text += std::format("\n  {} > {}: {} {:.2f}", formatName(a),
+                            formatName(b),
+                            converterCost(a, b) > 0 ? "converter" : "encoder",
+                            plan_detail::stepCost(a, b));
+        if (i + 1 < plan.steps) {
+            text += std::format(", intermediate {:.2f}", intermediateCost(b));
+        }
+    }
+    return text;
+}
+} // namespace image_conversion
+} // namespace core
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "image.h"
+#include "image_buffer_pool.hpp"
 
 #include <atomic>
+#include <iterator>
 #include <utility>
 
 #include <QtGlobal>
@@ -14,17 +16,23 @@
 #include <opencv2/imgproc.hpp>
 
 namespace core {
-inline int depthForFormat(Image::Format format) noexcept {
+constexpr int depthForFormat(Image::Format format) noexcept {
     switch (format) {
     case Image::bayer8_rggb:
     case Image::bayer8_grbg:
     case Image::bayer8_bggr:
     case Image::bayer8_gbrg:
+    case Image::grayscale8:
+        return 8;
+    case Image::yuv8_nv12:
+    case Image::yuv8_nv21:
+    case Image::yuv8_i420:
+    case Image::yuv8_yv12:
+        return 12;
     case Image::yuv8_uyvy:
     case Image::yuv8_yuy2:
     case Image::yuv8_yvyu:
-    case Image::grayscale8:
-        return 8;
+        return 16;
     case Image::bayer10_rggb:
     case Image::bayer10_grbg:
     case Image::bayer10_bggr:
@@ -42,6 +50,21 @@ inline int depthForFormat(Image::Format format) noexcept {
     case Image::bayer16_bggr:
     case Image::bayer16_gbrg:
         return 16;
+    case Image::bayer10p_rggb:
+    case Image::bayer10p_grbg:
+    case Image::bayer10p_bggr:
+    case Image::bayer10p_gbrg:
+        return 10;
+    case Image::bayer12p_rggb:
+    case Image::bayer12p_grbg:
+    case Image::bayer12p_bggr:
+    case Image::bayer12p_gbrg:
+        return 12;
+    case Image::bayer14p_rggb:
+    case Image::bayer14p_grbg:
+    case Image::bayer14p_bggr:
+    case Image::bayer14p_gbrg:
+        return 14;
     case Image::rgb24:
     case Image::bgr24:
         return 24;
@@ -55,7 +78,7 @@ inline int depthForFormat(Image::Format format) noexcept {
     }
 }
 
-inline int bitPlaneCountForFormat(Image::Format format) noexcept {
+constexpr int bitPlaneCountForFormat(Image::Format format) noexcept {
     switch (format) {
     case Image::bayer8_rggb:
     case Image::bayer8_grbg:
@@ -64,22 +87,38 @@ inline int bitPlaneCountForFormat(Image::Format format) noexcept {
     case Image::yuv8_uyvy:
     case Image::yuv8_yuy2:
     case Image::yuv8_yvyu:
+    case Image::yuv8_nv12:
+    case Image::yuv8_nv21:
+    case Image::yuv8_i420:
+    case Image::yuv8_yv12:
     case Image::grayscale8:
         return 8;
     case Image::bayer10_rggb:
     case Image::bayer10_grbg:
     case Image::bayer10_bggr:
     case Image::bayer10_gbrg:
+    case Image::bayer10p_rggb:
+    case Image::bayer10p_grbg:
+    case Image::bayer10p_bggr:
+    case Image::bayer10p_gbrg:
         return 10;
     case Image::bayer12_rggb:
     case Image::bayer12_grbg:
     case Image::bayer12_bggr:
     case Image::bayer12_gbrg:
+    case Image::bayer12p_rggb:
+    case Image::bayer12p_grbg:
+    case Image::bayer12p_bggr:
+    case Image::bayer12p_gbrg:
         return 12;
     case Image::bayer14_rggb:
     case Image::bayer14_grbg:
     case Image::bayer14_bggr:
     case Image::bayer14_gbrg:
+    case Image::bayer14p_rggb:
+    case Image::bayer14p_grbg:
+    case Image::bayer14p_bggr:
+    case Image::bayer14p_gbrg:
         return 14;
     case Image::bayer16_rggb:
     case Image::bayer16_grbg:
@@ -99,6 +138,195 @@ inline int bitPlaneCountForFormat(Image::Format format) noexcept {
     }
 }
 
+constexpr bool isPackedFormat(Image::Format format) noexcept {
+    return format >= Image::bayer10p_rggb && format <= Image::bayer14p_gbrg;
+}
+
+// The 16 bits per sample format a packed format unpacks to.
+constexpr Image::Format unpackedFormatFor(Image::Format format) noexcept {
+    switch (format) {
+    case Image::bayer10p_rggb:
+        return Image::bayer10_rggb;
+    case Image::bayer10p_grbg:
+        return Image::bayer10_grbg;
+    case Image::bayer10p_bggr:
+        return Image::bayer10_bggr;
+    case Image::bayer10p_gbrg:
+        return Image::bayer10_gbrg;
+    case Image::bayer12p_rggb:
+        return Image::bayer12_rggb;
+    case Image::bayer12p_grbg:
+        return Image::bayer12_grbg;
+    case Image::bayer12p_bggr:
+        return Image::bayer12_bggr;
+    case Image::bayer12p_gbrg:
+        return Image::bayer12_gbrg;
+    case Image::bayer14p_rggb:
+        return Image::bayer14_rggb;
+    case Image::bayer14p_grbg:
+        return Image::bayer14_grbg;
+    case Image::bayer14p_bggr:
+        return Image::bayer14_bggr;
+    case Image::bayer14p_gbrg:
+        return Image::bayer14_gbrg;
+    default:
+        return Image::invalid;
+    }
+}
+
+// The 8 bits bayer format with the same CFA order as a packed format.
+constexpr Image::Format bayer8FormatFor(Image::Format format) noexcept {
+    switch (format) {
+    case Image::bayer10p_rggb:
+    case Image::bayer12p_rggb:
+    case Image::bayer14p_rggb:
+        return Image::bayer8_rggb;
+    case Image::bayer10p_grbg:
+    case Image::bayer12p_grbg:
+    case Image::bayer14p_grbg:
+        return Image::bayer8_grbg;
+    case Image::bayer10p_bggr:
+    case Image::bayer12p_bggr:
+    case Image::bayer14p_bggr:
+        return Image::bayer8_bggr;
+    case Image::bayer10p_gbrg:
+    case Image::bayer12p_gbrg:
+    case Image::bayer14p_gbrg:
+        return Image::bayer8_gbrg;
+    default:
+        return Image::invalid;
+    }
+}
+
+constexpr bool isYuv420Format(Image::Format format) noexcept {
+    return format >= Image::yuv8_nv12 && format <= Image::yuv8_yv12;
+}
+
+// Whether V precedes U in the chroma plane(s) of a 4:2:0 format.
+constexpr bool isChromaVFirst(Image::Format format) noexcept {
+    return format == Image::yuv8_nv21 || format == Image::yuv8_yv12;
+}
+
+inline int planeCountForFormat(Image::Format format) noexcept {
+    switch (format) {
+    case Image::yuv8_nv12:
+    case Image::yuv8_nv21:
+        return 2;
+    case Image::yuv8_i420:
+    case Image::yuv8_yv12:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+// Rows of a plane of an image with the given height.
+inline int planeHeight(Image::Format format, int height, int plane) noexcept {
+    return plane > 0 && isYuv420Format(format) ? height / 2 : height;
+}
+
+// Bytes of pixel data in a row of a plane of an image with the given width.
+inline int planeRowBytes(Image::Format format, int width, int plane) noexcept {
+    switch (format) {
+    case Image::yuv8_nv12:
+    case Image::yuv8_nv21:
+        return width;
+    case Image::yuv8_i420:
+    case Image::yuv8_yv12:
+        return plane == 0 ? width : width / 2;
+    default:
+        return static_cast<int>(qsizetype(width) * depthForFormat(format) / 8);
+    }
+}
+
+// Stride of a plane in the contiguous layout built from the first stride.
+inline int planeBytesPerLine(Image::Format format, int bytesPerLine,
+                             int plane) noexcept {
+    return plane > 0 && planeCountForFormat(format) == 3 ? bytesPerLine / 2
+                                                         : bytesPerLine;
+}
+
+// Offset of a plane in the contiguous layout built from the first stride.
+inline qsizetype planeOffset(Image::Format format, int height, int bytesPerLine,
+                             int plane) noexcept {
+    qsizetype offset = 0;
+    for (int i = 0; i < plane; ++i) {
+        offset += qsizetype(planeHeight(format, height, i)) *
+                  planeBytesPerLine(format, bytesPerLine, i);
+    }
+    return offset;
+}
+
+// Horizontal pixel granularity of a format; views must start on a multiple.
+inline int pixelGroupForFormat(Image::Format format) noexcept {
+    switch (format) {
+    case Image::yuv8_uyvy:
+    case Image::yuv8_yuy2:
+    case Image::yuv8_yvyu:
+    case Image::yuv8_nv12:
+    case Image::yuv8_nv21:
+    case Image::yuv8_i420:
+    case Image::yuv8_yv12:
+        return 2;
+    case Image::bayer10p_rggb:
+    case Image::bayer10p_grbg:
+    case Image::bayer10p_bggr:
+    case Image::bayer10p_gbrg:
+    case Image::bayer14p_rggb:
+    case Image::bayer14p_grbg:
+    case Image::bayer14p_bggr:
+    case Image::bayer14p_gbrg:
+        return 4;
+    case Image::bayer12p_rggb:
+    case Image::bayer12p_grbg:
+    case Image::bayer12p_bggr:
+    case Image::bayer12p_gbrg:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// The CFA order seen from pixel (x, y) of a bayer image.
+inline Image::Format bayerFormatAt(Image::Format format, int x,
+                                   int y) noexcept {
+    static constexpr Image::Format orders[][4] = {
+            {Image::bayer8_rggb, Image::bayer8_grbg, Image::bayer8_bggr,
+             Image::bayer8_gbrg},
+            {Image::bayer10_rggb, Image::bayer10_grbg, Image::bayer10_bggr,
+             Image::bayer10_gbrg},
+            {Image::bayer12_rggb, Image::bayer12_grbg, Image::bayer12_bggr,
+             Image::bayer12_gbrg},
+            {Image::bayer14_rggb, Image::bayer14_grbg, Image::bayer14_bggr,
+             Image::bayer14_gbrg},
+            {Image::bayer16_rggb, Image::bayer16_grbg, Image::bayer16_bggr,
+             Image::bayer16_gbrg},
+            {Image::bayer10p_rggb, Image::bayer10p_grbg, Image::bayer10p_bggr,
+             Image::bayer10p_gbrg},
+            {Image::bayer12p_rggb, Image::bayer12p_grbg, Image::bayer12p_bggr,
+             Image::bayer12p_gbrg},
+            {Image::bayer14p_rggb, Image::bayer14p_grbg, Image::bayer14p_bggr,
+             Image::bayer14p_gbrg},
+    };
+    // indexed by [(x & 1) | (y & 1) << 1][order]
+    static constexpr int shifted[4][4] = {
+            {0, 1, 2, 3},
+            {1, 0, 3, 2},
+            {3, 2, 1, 0},
+            {2, 3, 0, 1},
+    };
+
+    const int shift = (x & 1) | ((y & 1) << 1);
+    for (const auto& group : orders) {
+        for (int i = 0; i < 4; ++i) {
+            if (group[i] == format) {
+                return group[shifted[shift][i]];
+            }
+        }
+    }
+    return format;
+}
+
 inline Image::Format formatFromQImageFormat(QImage::Format format) noexcept {
     switch (format) {
     case QImage::Format_RGB32:
@@ -150,6 +378,28 @@ inline QImage::Format qImageFormatFromFormat(Image::Format format) noexcept {
     }
 }
 
+// The enumerator's name, for logs.
+constexpr const char* formatName(Image::Format format) noexcept {
+    constexpr const char* names[] = {
+            "invalid",       "bayer8_rggb",   "bayer8_grbg",   "bayer8_bggr",
+            "bayer8_gbrg",   "yuv8_uyvy",     "yuv8_yuy2",     "yuv8_yvyu",
+            "yuv8_nv12",     "yuv8_nv21",     "yuv8_i420",     "yuv8_yv12",
+            "rgb24",         "bgr24",         "rgba32",        "bgra32",
+            "argb32",        "abgr32",        "grayscale8",    "bayer10_rggb",
+            "bayer10_grbg",  "bayer10_bggr",  "bayer10_gbrg",  "bayer12_rggb",
+            "bayer12_grbg",  "bayer12_bggr",  "bayer12_gbrg",  "bayer14_rggb",
+            "bayer14_grbg",  "bayer14_bggr",  "bayer14_gbrg",  "bayer16_rggb",
+            "bayer16_grbg",  "bayer16_bggr",  "bayer16_gbrg",  "bayer10p_rggb",
+            "bayer10p_grbg", "bayer10p_bggr", "bayer10p_gbrg", "bayer12p_rggb",
+            "bayer12p_grbg", "bayer12p_bggr", "bayer12p_gbrg", "bayer14p_rggb",
+            "bayer14p_grbg", "bayer14p_bggr", "bayer14p_gbrg",
+    };
+    static_assert(std::size(names) == Image::formatCount);
+
+    const int i = static_cast<int>(format);
+    return i >= 0 && i < Image::formatCount ? names[i] : "invalid";
+}
+
 struct ImageSizeParams {
     qsizetype nBytes{0};
     int depth{0};
@@ -160,7 +410,8 @@ struct ImageSizeParams {
 
 inline ImageSizeParams calculateImageSizeParams(int width, int height,
                                                 Image::Format format,
-                                                int bytesPerLine = -1) {
+                                                int bytesPerLine = -1,
+                                                int lineAlignment = 1) {
     using SafeSize = boost::safe_numerics::safe<qsizetype>;
     using SafeInt = boost::safe_numerics::safe<int>;
 
@@ -179,16 +430,38 @@ inline ImageSizeParams calculateImageSizeParams(int width, int height,
         throw BadImage("Unsupported image format.");
     }
 
-    const auto [bpl, isContinuous] = [width, depth, bytesPerLine]() {
-        const int perfectBpl = SafeInt(width) * (depth >> 3);
+    if (width % pixelGroupForFormat(format) != 0 && isPackedFormat(format)) {
+        throw BadImage("Image width does not fill whole packed pixel groups.");
+    }
+
+    if (isYuv420Format(format) &&
+        (width % 2 != 0 || height % 2 != 0 ||
+         (bytesPerLine > 0 && bytesPerLine % 2 != 0))) {
+        throw BadImage("YUV 4:2:0 size and bytes per line must be even.");
+    }
+
+    // the bytes per line of multi-plane formats are those of the Y plane
+    const int rowDepth = isYuv420Format(format) ? 8 : depth;
+
+    const auto [bpl, isContinuous] = [width, rowDepth, bytesPerLine,
+                                      lineAlignment]() {
+        const int perfectBpl = SafeInt(width) * rowDepth / 8;
         if (bytesPerLine > 0 && bytesPerLine < perfectBpl) {
             throw BadImage("Bytes per line is too small.");
         }
+        if (bytesPerLine <= 0 && lineAlignment > 1) {
+            const int alignedBpl = (SafeInt(perfectBpl) + (lineAlignment - 1)) /
+                                   lineAlignment * lineAlignment;
+            return std::pair(alignedBpl, alignedBpl == perfectBpl);
+        }
         return std::pair((std::max)(bytesPerLine, perfectBpl),
                          bytesPerLine <= 0 || bytesPerLine == perfectBpl);
     }();
 
-    const qsizetype nBytes = height * SafeSize(bpl);
+    // every plane after the first holds half as many rows
+    const qsizetype nBytes =
+            isYuv420Format(format) ? height / 2 * SafeSize(bpl) * 3
+                                   : height * SafeSize(bpl);
 
     return ImageSizeParams(nBytes, depth, bpc, bpl, isContinuous);
 }
@@ -217,6 +490,24 @@ public:
     virtual Format format() const noexcept = 0;
     virtual bool isContinuous() const noexcept = 0;
 
+    // Multi-plane access. The defaults describe the contiguous layout, with
+    // every plane following the previous one.
+    virtual int planeCount() const noexcept {
+        return planeCountForFormat(format());
+    }
+
+    virtual uchar* planeBits(int plane) noexcept {
+        return bits() + planeOffset(format(), height(), bytesPerLine(), plane);
+    }
+
+    virtual const uchar* planeBits(int plane) const noexcept {
+        return bits() + planeOffset(format(), height(), bytesPerLine(), plane);
+    }
+
+    virtual int planeBytesPerLine(int plane) const noexcept {
+        return core::planeBytesPerLine(format(), bytesPerLine(), plane);
+    }
+
     virtual QImage toQImage() const {
         QImage qimage(
                 bits(), width(), height(), bytesPerLine(),
@@ -233,6 +524,10 @@ public:
         return qimage;
     }
 
+    bool isShared() const noexcept {
+        return m_rc.load(std::memory_order_acquire) != 1;
+    }
+
     void ref() const noexcept {
         m_rc.fetch_add(1, std::memory_order_relaxed);
     }
@@ -250,19 +545,26 @@ private:
 
 class ImageData : public ImagePrivate {
 public:
+    using Allocation = Image::Allocation;
+
     ImageData() noexcept :
             m_ptr(nullptr), m_nBytes(0), m_width(0), m_height(0), m_depth(0),
-            m_bpc(0), m_bpl(0), m_format(invalid) {}
+            m_bpc(0), m_bpl(0), m_format(invalid), m_isContinuous(true) {}
 
     ImageData(int width, int height, Format format,
-              const ImageSizeParams& params) :
-            m_ptr(new uchar[params.nBytes]()),
+              const ImageSizeParams& params,
+              Allocation allocation = Allocation::zeroed) :
+            m_ptr(ImageBufferPool::instance().acquire(params.nBytes, format)),
             m_nBytes(params.nBytes), m_width(width), m_height(height),
             m_depth(params.depth), m_bpc(params.bpc), m_bpl(params.bpl),
-            m_format(format) {}
+            m_format(format), m_isContinuous(params.isContinuous) {
+        if (allocation == Allocation::zeroed) {
+            std::fill_n(m_ptr, m_nBytes, uchar(0));
+        }
+    }
 
     virtual ~ImageData() {
-        delete[] m_ptr;
+        ImageBufferPool::instance().release(m_ptr, m_nBytes, m_format);
     }
 
     virtual uchar* bits() noexcept override {
@@ -302,7 +604,7 @@ public:
     }
 
     virtual bool isContinuous() const noexcept override {
-        return true;
+        return m_isContinuous;
     }
 
 private:
@@ -314,6 +616,7 @@ private:
     int m_bpc;
     int m_bpl;
     Format m_format;
+    bool m_isContinuous;
 };
 
 class ImageUserData : public ImagePrivate {
@@ -399,7 +702,8 @@ public:
 
     QImageHolder(const QImage& image, Format format) : QImageHolder() {
         m_format = format;
-        m_isContinuous = image.width() * image.depth() == image.bytesPerLine();
+        m_isContinuous =
+                image.width() * (image.depth() >> 3) == image.bytesPerLine();
         m_image = image;
     }
 
@@ -453,11 +757,223 @@ private:
     bool m_isContinuous;
 };
 
-inline ImagePrivate* createImagePrivate(int width, int height,
-                                        Image::Format format) {
-    const auto params = calculateImageSizeParams(width, height, format);
-    return params.nBytes > 0 ? new ImageData(width, height, format, params)
-                             : nullptr;
+class ImagePlanesUserData : public ImagePrivate {
+public:
+    using CleanupFunction = Image::CleanupFunction;
+    static constexpr int maxPlanes = 3;
+
+    ImagePlanesUserData(uchar* const* planes, const int* bytesPerLine,
+                        int width, int height, Format format,
+                        CleanupFunction cleanup) noexcept :
+            m_cleanup(cleanup), m_width(width), m_height(height),
+            m_format(format), m_isContinuous(true) {
+        const int count = planeCountForFormat(format);
+        for (int i = 0; i < count; ++i) {
+            m_planes[i] = planes[i];
+            m_bpl[i] = bytesPerLine[i];
+            m_isContinuous = m_isContinuous &&
+                             m_bpl[i] == planeRowBytes(format, width, i) &&
+                             m_planes[i] == m_planes[0] +
+                                     planeOffset(format, height, m_bpl[0], i);
+        }
+    }
+
+    virtual ~ImagePlanesUserData() {
+        if (m_cleanup) {
+            m_cleanup(m_planes[0]);
+        }
+    }
+
+    virtual uchar* bits() noexcept override {
+        return m_planes[0];
+    }
+
+    virtual const uchar* bits() const noexcept override {
+        return m_planes[0];
+    }
+
+    virtual qsizetype sizeInBytes() const noexcept override {
+        qsizetype size = 0;
+        for (int i = 0; i < planeCount(); ++i) {
+            size += qsizetype(planeHeight(m_format, m_height, i)) * m_bpl[i];
+        }
+        return size;
+    }
+
+    virtual int width() const noexcept override {
+        return m_width;
+    }
+
+    virtual int height() const noexcept override {
+        return m_height;
+    }
+
+    virtual int depth() const noexcept override {
+        return depthForFormat(m_format);
+    }
+
+    virtual int bitPlaneCount() const noexcept override {
+        return bitPlaneCountForFormat(m_format);
+    }
+
+    virtual int bytesPerLine() const noexcept override {
+        return m_bpl[0];
+    }
+
+    virtual Format format() const noexcept override {
+        return m_format;
+    }
+
+    virtual bool isContinuous() const noexcept override {
+        return m_isContinuous;
+    }
+
+    virtual uchar* planeBits(int plane) noexcept override {
+        return m_planes[plane];
+    }
+
+    virtual const uchar* planeBits(int plane) const noexcept override {
+        return m_planes[plane];
+    }
+
+    virtual int planeBytesPerLine(int plane) const noexcept override {
+        return m_bpl[plane];
+    }
+
+private:
+    uchar* m_planes[maxPlanes]{};
+    int m_bpl[maxPlanes]{};
+    CleanupFunction m_cleanup;
+    int m_width;
+    int m_height;
+    Format m_format;
+    bool m_isContinuous;
+};
+
+class ImageView : public ImagePrivate {
+public:
+    ImageView(ImagePrivate* parent, const QRect& rect, Format format) noexcept :
+            m_parent(parent),
+            m_offset(qsizetype(rect.y()) * parent->bytesPerLine() +
+                     planeRowBytes(format, rect.x(), 0)),
+            m_x(rect.x()), m_y(rect.y()), m_width(rect.width()),
+            m_height(rect.height()), m_format(format),
+            m_isContinuous(parent->isContinuous() &&
+                           rect.width() == parent->width() &&
+                           parent->planeCount() == 1) {
+        m_parent->ref();
+    }
+
+    virtual ~ImageView() {
+        m_parent->dref();
+    }
+
+    virtual uchar* bits() noexcept override {
+        return m_parent->bits() + m_offset;
+    }
+
+    virtual const uchar* bits() const noexcept override {
+        return static_cast<const ImagePrivate*>(m_parent)->bits() + m_offset;
+    }
+
+    virtual qsizetype sizeInBytes() const noexcept override {
+        return qsizetype(m_height - 1) * bytesPerLine() +
+               qsizetype(m_width) * depth() / 8;
+    }
+
+    virtual int width() const noexcept override {
+        return m_width;
+    }
+
+    virtual int height() const noexcept override {
+        return m_height;
+    }
+
+    virtual int depth() const noexcept override {
+        return m_parent->depth();
+    }
+
+    virtual int bitPlaneCount() const noexcept override {
+        return m_parent->bitPlaneCount();
+    }
+
+    virtual int bytesPerLine() const noexcept override {
+        return m_parent->bytesPerLine();
+    }
+
+    virtual Format format() const noexcept override {
+        return m_format;
+    }
+
+    virtual bool isContinuous() const noexcept override {
+        return m_isContinuous;
+    }
+
+    virtual uchar* planeBits(int plane) noexcept override {
+        return m_parent->planeBits(plane) + planeOffsetInParent(plane);
+    }
+
+    virtual const uchar* planeBits(int plane) const noexcept override {
+        return static_cast<const ImagePrivate*>(m_parent)->planeBits(plane) +
+               planeOffsetInParent(plane);
+    }
+
+    virtual int planeBytesPerLine(int plane) const noexcept override {
+        return m_parent->planeBytesPerLine(plane);
+    }
+
+private:
+    qsizetype planeOffsetInParent(int plane) const noexcept {
+        return qsizetype(planeHeight(m_format, m_y, plane)) *
+                       m_parent->planeBytesPerLine(plane) +
+               planeRowBytes(m_format, m_x, plane);
+    }
+
+    ImagePrivate* m_parent;
+    qsizetype m_offset;
+    int m_x;
+    int m_y;
+    int m_width;
+    int m_height;
+    Format m_format;
+    bool m_isContinuous;
+};
+
+inline ImagePrivate* createImageView(ImagePrivate* p, const QRect& rect) {
+    if (!p) {
+        return nullptr;
+    }
+
+    const QRect clipped = rect.intersected(QRect(0, 0, p->width(), p->height()));
+    if (clipped.isEmpty()) {
+        return nullptr;
+    }
+
+    if (clipped.x() % pixelGroupForFormat(p->format()) != 0) {
+        throw BadImage("View must start on a pixel group boundary.");
+    }
+
+    if (isYuv420Format(p->format()) &&
+        (clipped.y() % 2 != 0 || clipped.width() % 2 != 0 ||
+         clipped.height() % 2 != 0)) {
+        throw BadImage("YUV 4:2:0 view must start and end on even pixels.");
+    }
+
+    return new ImageView(p, clipped,
+                         bayerFormatAt(p->format(), clipped.x(), clipped.y()));
+}
+
+inline ImagePrivate* createImagePrivate(
+        int width, int height, Image::Format format,
+        Image::Allocation allocation = Image::Allocation::zeroed) {
+    const int lineAlignment = allocation == Image::Allocation::aligned
+                                      ? Image::storageAlignment
+                                      : 1;
+    const auto params = calculateImageSizeParams(width, height, format, -1,
+                                                 lineAlignment);
+    return params.nBytes > 0
+                   ? new ImageData(width, height, format, params, allocation)
+                   : nullptr;
 }
 
 inline ImagePrivate* createImagePrivate(uchar* data, int width, int height,
@@ -469,35 +985,71 @@ inline ImagePrivate* createImagePrivate(uchar* data, int width, int height,
                              : nullptr;
 }
 
+inline ImagePrivate* createImagePrivate(uchar* const* planes,
+                                        const int* bytesPerLine, int width,
+                                        int height, Image::Format format,
+                                        Image::CleanupFunction cleanup) {
+    if (planeCountForFormat(format) == 1) {
+        return createImagePrivate(planes[0], width, height, format,
+                                  bytesPerLine[0], cleanup);
+    }
+
+    const auto params = calculateImageSizeParams(width, height, format,
+                                                 bytesPerLine[0]);
+    for (int i = 1; i < planeCountForFormat(format); ++i) {
+        if (bytesPerLine[i] < planeRowBytes(format, width, i)) {
+            throw BadImage("Bytes per line is too small.");
+        }
+    }
+
+    return params.nBytes > 0
+                   ? new ImagePlanesUserData(planes, bytesPerLine, width,
+                                             height, format, cleanup)
+                   : nullptr;
+}
+
 inline ImagePrivate* createImagePrivate(const QImage& image) {
     const auto format = formatFromQImageFormat(image.format());
     return format == Image::invalid ? nullptr : new QImageHolder(image, format);
 }
 
+// Copies pixels between images of the same format and size, whatever their
+// strides.
+inline void copyImagePrivate(const ImagePrivate& src, ImagePrivate& dst) {
+    Q_ASSERT(src.format() == dst.format() && src.width() == dst.width() &&
+             src.height() == dst.height());
+
+    if (src.isContinuous() && dst.isContinuous()) {
+        std::copy_n(src.bits(), src.sizeInBytes(), dst.bits());
+        return;
+    }
+
+    for (int plane = 0; plane < src.planeCount(); ++plane) {
+        const uchar* in = src.planeBits(plane);
+        uchar* out = dst.planeBits(plane);
+        const int inStep = src.planeBytesPerLine(plane);
+        const int outStep = dst.planeBytesPerLine(plane);
+        const int rowBytes = planeRowBytes(src.format(), src.width(), plane);
+
+        for (int i = 0; i < planeHeight(src.format(), src.height(), plane);
+             ++i) {
+            std::copy_n(in, rowBytes, out);
+            in += inStep;
+            out += outStep;
+        }
+    }
+}
+
 inline ImagePrivate* cloneImagePrivate(ImagePrivate* p) {
     if (!p) {
         return nullptr;
     }
 
     std::unique_ptr<ImagePrivate> replica(
-            createImagePrivate(p->width(), p->height(), p->format()));
+            createImagePrivate(p->width(), p->height(), p->format(),
+                               Image::Allocation::uninitialized));
     if (replica) {
-        if (p->isContinuous()) {
-            std::copy_n(p->bits(), p->sizeInBytes(), replica->bits());
-        } else {
-            const uchar* src = p->bits();
-            uchar* dst = replica->bits();
-            const int srcStep = p->bytesPerLine();
-            const int dstStep = replica->bytesPerLine();
-
-            Q_ASSERT(srcStep > dstStep);
-
-            for (int i = 0; i < p->height(); ++i) {
-                std::copy_n(src, dstStep, dst);
-                src += srcStep;
-                dst += dstStep;
-            }
-        }
+        copyImagePrivate(*p, *replica);
     }
 
     return replica.release();
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "cpu_features.hpp"
+#include "image.h"
+
+#include <memory>
+#include <vector>
+
+#include <QtGlobal>
+
+#ifdef CORE_X86
+#include <immintrin.h>
+#endif
+
+namespace core {
+namespace image_conversion {
+inline void halveRowScalar(const uchar* top, const uchar* bottom, uchar* dst,
+                           int x, int width) noexcept {
+    for (; x < width; ++x) {
+        const uchar* a = top + x * 8;
+        const uchar* b = bottom + x * 8;
+        for (int c = 0; c < 4; ++c) {
+            dst[x * 4 + c] = uchar((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+        }
+    }
+}
+
+#ifdef CORE_X86
+// 16-bit sums of each channel of 4 source pixels' horizontal pairs, over
+// both rows: the pairs are shuffled next to each other, then added by a
+// multiply-add with ones.
+CORE_TARGET("ssse3")
+inline __m128i halvedSums(const uchar* top, const uchar* bottom) noexcept {
+    const __m128i pairs = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13,
+                                        10, 14, 11, 15);
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top));
+    const __m128i b =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom));
+    return _mm_add_epi16(_mm_maddubs_epi16(_mm_shuffle_epi8(a, pairs), ones),
+                         _mm_maddubs_epi16(_mm_shuffle_epi8(b, pairs), ones));
+}
+
+// 4 destination pixels per iteration from 8 on each source row.
+CORE_TARGET("ssse3")
+inline int halveRowSsse3(const uchar* top, const uchar* bottom, uchar* dst,
+                         int width) noexcept {
+    const __m128i round = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i low = _mm_srli_epi16(
+                _mm_add_epi16(halvedSums(top + x * 8, bottom + x * 8), round),
+                2);
+        const __m128i high = _mm_srli_epi16(
+                _mm_add_epi16(halvedSums(top + x * 8 + 16, bottom + x * 8 + 16),
+                              round),
+                2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),
+                         _mm_packus_epi16(low, high));
+    }
+    return x;
+}
+#endif
+
+// Averages each 2x2 block of a 32-bit image into one pixel of dst, which is
+// half its size rounded down; an odd last row or column is dropped.
+inline void halve(const Image& src, Image& dst) noexcept {
+    const int width = dst.width();
+    const bool ssse3 = cpuFeatures().ssse3;
+    for (int y = 0; y < dst.height(); ++y) {
+        const uchar* top = src.bits() + qsizetype(2 * y) * src.bytesPerLine();
+        const uchar* bottom = top + src.bytesPerLine();
+        uchar* out = dst.bits() + qsizetype(y) * dst.bytesPerLine();
+        int x = 0;
+#ifdef CORE_X86
+        if (ssse3) {
+            x = halveRowSsse3(top, bottom, out, width);
+        }
+#else
+        Q_UNUSED(ssse3);
+#endif
+        halveRowScalar(top, bottom, out, x, width);
+    }
+}
+} // namespace image_conversion
+
+// A paintable frame and its successive halvings, for views painting it at
+// several sizes or zoom levels: each paints from the smallest level at
+// least as large as it needs and only resamples that. Immutable once built,
+// so every view of a frame shares one; dropping the last reference when the
+// next frame arrives hands the levels' storage back to the buffer pool.
+class ImagePyramid {
+public:
+    // Levels stop once either side would be under this.
+    static constexpr int minLevelSide = 32;
+
+    ImagePyramid() = default;
+
+    // base must be in Image::paintableFormat.
+    explicit ImagePyramid(Image base) {
+        if (base.isNull() || base.format() != Image::paintableFormat) {
+            return;
+        }
+        m_levels.push_back(std::move(base));
+        for (;;) {
+            const Image& last = m_levels.back();
+            const QSize half(last.width() / 2, last.height() / 2);
+            if (half.width() < minLevelSide || half.height() < minLevelSide) {
+                break;
+            }
+            Image level(half, Image::paintableFormat,
+                        Image::Allocation::aligned);
+            image_conversion::halve(last, level);
+            m_levels.push_back(std::move(level));
+        }
+    }
+
+    bool isNull() const noexcept {
+        return m_levels.empty();
+    }
+
+    int levelCount() const noexcept {
+        return int(m_levels.size());
+    }
+
+    const Image& level(int i) const noexcept {
+        return m_levels[i];
+    }
+
+    QSize size() const noexcept {
+        return isNull() ? QSize() : m_levels.front().size();
+    }
+
+    // The smallest level covering size in both dimensions, the full size
+    // one when size is larger.
+    const Image& levelFor(const QSize& size) const noexcept {
+        int i = 0;
+        while (i + 1 < levelCount() &&
+               m_levels[i + 1].width() >= size.width() &&
+               m_levels[i + 1].height() >= size.height()) {
+            ++i;
+        }
+        return m_levels[i];
+    }
+
+private:
+    std::vector<Image> m_levels;
+};
+
+using ImagePyramidPointer = std::shared_ptr<const ImagePyramid>;
+} // namespace core
+
+REGISTER_QT_METATYPE(core::ImagePyramidPointer, core__ImagePyramidPointer)
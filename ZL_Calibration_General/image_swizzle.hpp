@@ -0,0 +1,284 @@
+#pragma once
+
+#include "cpu_features.hpp"
+#include "image_private.hpp"
+
+#include <algorithm>
+#include <climits>
+
+#include <QtGlobal>
+
+#include <opencv2/core.hpp>
+
+#ifdef CORE_X86
+#include <immintrin.h>
+#endif
+
+namespace core {
+namespace image_conversion {
+// Single pass channel permutation between the 8-bit rgb/bgr/rgba/bgra/argb/
+// abgr layouts. Every pair, including 3 <-> 4 channel packing, is one byte
+// shuffle plus an OR for a filled alpha, so one kernel per instruction set
+// serves them all with the shuffle mask built per pair.
+struct SwizzlePlan {
+    int srcChannels{0};
+    int dstChannels{0};
+    // source channel of each destination channel, -1 for an opaque alpha
+    int from[4]{-1, -1, -1, -1};
+    // pixels moved by one 16 byte shuffle
+    int blockPixels{0};
+    // pixels a 16 byte load or store may span from the block start
+    int guard{0};
+    alignas(16) uchar shuffle[16]{};
+    alignas(16) uchar alpha[16]{};
+};
+
+constexpr bool isSwizzleFormat(Image::Format format) noexcept {
+    switch (format) {
+    case Image::rgb24:
+    case Image::bgr24:
+    case Image::rgba32:
+    case Image::bgra32:
+    case Image::argb32:
+    case Image::abgr32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+namespace swizzle_detail {
+// Byte positions of R, G, B and A within a pixel, A is -1 when absent.
+struct ChannelPositions {
+    int channels;
+    int position[4];
+};
+
+constexpr ChannelPositions channelPositions(Image::Format format) noexcept {
+    switch (format) {
+    case Image::rgb24:
+        return {3, {0, 1, 2, -1}};
+    case Image::bgr24:
+        return {3, {2, 1, 0, -1}};
+    case Image::rgba32:
+        return {4, {0, 1, 2, 3}};
+    case Image::bgra32:
+        return {4, {2, 1, 0, 3}};
+    case Image::argb32:
+        return {4, {1, 2, 3, 0}};
+    case Image::abgr32:
+        return {4, {3, 2, 1, 0}};
+    default:
+        return {0, {-1, -1, -1, -1}};
+    }
+}
+} // namespace swizzle_detail
+
+// Both formats must satisfy isSwizzleFormat().
+inline SwizzlePlan swizzlePlan(Image::Format from, Image::Format to) noexcept {
+    const auto src = swizzle_detail::channelPositions(from);
+    const auto dst = swizzle_detail::channelPositions(to);
+
+    SwizzlePlan plan;
+    plan.srcChannels = src.channels;
+    plan.dstChannels = dst.channels;
+    for (int k = 0; k < 4; ++k) {
+        if (dst.position[k] >= 0) {
+            plan.from[dst.position[k]] = src.position[k];
+        }
+    }
+
+    plan.blockPixels = src.channels == 3 && dst.channels == 3 ? 5 : 4;
+    plan.guard = (16 + (std::min)(src.channels, dst.channels) - 1) /
+                 (std::min)(src.channels, dst.channels);
+
+    for (uchar& b : plan.shuffle) {
+        b = 0x80;
+    }
+    for (int p = 0; p < plan.blockPixels; ++p) {
+        for (int c = 0; c < plan.dstChannels; ++c) {
+            const int i = p * plan.dstChannels + c;
+            if (plan.from[c] < 0) {
+                plan.alpha[i] = 0xff;
+            } else {
+                plan.shuffle[i] = uchar(p * plan.srcChannels + plan.from[c]);
+            }
+        }
+    }
+    return plan;
+}
+
+using SwizzleRow = void (*)(const uchar* src, uchar* dst, int width,
+                            const SwizzlePlan& plan);
+
+inline void swizzleRowScalar(const uchar* src, uchar* dst, int width,
+                             const SwizzlePlan& plan) noexcept {
+    const int sc = plan.srcChannels;
+    const int dc = plan.dstChannels;
+    for (int x = 0; x < width; ++x, src += sc, dst += dc) {
+        for (int c = 0; c < dc; ++c) {
+            dst[c] = plan.from[c] < 0 ? uchar(255) : src[plan.from[c]];
+        }
+    }
+}
+
+#ifdef CORE_X86
+// Stores may write up to a pixel's worth of garbage past the block; the next
+// block or the scalar tail overwrites it, and guard keeps it inside the row.
+CORE_TARGET("ssse3")
+inline void swizzleRowSsse3(const uchar* src, uchar* dst, int width,
+                            const SwizzlePlan& plan) noexcept {
+    const int sc = plan.srcChannels;
+    const int dc = plan.dstChannels;
+    const int step = plan.blockPixels;
+    const __m128i shuffle =
+            _mm_load_si128(reinterpret_cast<const __m128i*>(plan.shuffle));
+    const __m128i alpha =
+            _mm_load_si128(reinterpret_cast<const __m128i*>(plan.alpha));
+
+    int x = 0;
+    for (; x + plan.guard <= width; x += step) {
+        const __m128i in =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * sc));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * dc),
+                         _mm_or_si128(_mm_shuffle_epi8(in, shuffle), alpha));
+    }
+    swizzleRowScalar(src + x * sc, dst + x * dc, width - x, plan);
+}
+
+// Two blocks per iteration, one per 128-bit lane.
+CORE_TARGET("avx2")
+inline void swizzleRowAvx2(const uchar* src, uchar* dst, int width,
+                           const SwizzlePlan& plan) noexcept {
+    const int sc = plan.srcChannels;
+    const int dc = plan.dstChannels;
+    const int step = plan.blockPixels;
+    const __m256i shuffle = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(plan.shuffle)));
+    const __m256i alpha = _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(plan.alpha)));
+
+    int x = 0;
+    for (; x + step + plan.guard <= width; x += 2 * step) {
+        const uchar* s = src + x * sc;
+        uchar* d = dst + x * dc;
+
+        __m256i v;
+        if (sc == 4) {
+            v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        } else {
+            v = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(s))),
+                    _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(s + step * sc)),
+                    1);
+        }
+
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+
+        if (dc == 4) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(d), v);
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                             _mm256_castsi256_si128(v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + step * dc),
+                             _mm256_extracti128_si256(v, 1));
+        }
+    }
+    swizzleRowSsse3(src + x * sc, dst + x * dc, width - x, plan);
+}
+
+// Four blocks per iteration, one per 128-bit lane.
+CORE_TARGET("avx512f,avx512bw")
+inline void swizzleRowAvx512(const uchar* src, uchar* dst, int width,
+                             const SwizzlePlan& plan) noexcept {
+    const int sc = plan.srcChannels;
+    const int dc = plan.dstChannels;
+    const int step = plan.blockPixels;
+    const __m512i shuffle = _mm512_broadcast_i32x4(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(plan.shuffle)));
+    const __m512i alpha = _mm512_broadcast_i32x4(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(plan.alpha)));
+
+    const auto load = [](const uchar* p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    };
+    const auto store = [](uchar* p, __m128i v) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+    };
+
+    int x = 0;
+    for (; x + 3 * step + plan.guard <= width; x += 4 * step) {
+        const uchar* s = src + x * sc;
+        uchar* d = dst + x * dc;
+
+        __m512i v;
+        if (sc == 4) {
+            v = _mm512_loadu_si512(s);
+        } else {
+            v = _mm512_castsi128_si512(load(s));
+            v = _mm512_inserti32x4(v, load(s + step * sc), 1);
+            v = _mm512_inserti32x4(v, load(s + 2 * step * sc), 2);
+            v = _mm512_inserti32x4(v, load(s + 3 * step * sc), 3);
+        }
+
+        v = _mm512_or_si512(_mm512_shuffle_epi8(v, shuffle), alpha);
+
+        if (dc == 4) {
+            _mm512_storeu_si512(d, v);
+        } else {
+            store(d, _mm512_castsi512_si128(v));
+            store(d + step * dc, _mm512_extracti32x4_epi32(v, 1));
+            store(d + 2 * step * dc, _mm512_extracti32x4_epi32(v, 2));
+            store(d + 3 * step * dc, _mm512_extracti32x4_epi32(v, 3));
+        }
+    }
+    swizzleRowAvx2(src + x * sc, dst + x * dc, width - x, plan);
+}
+#endif
+
+// The widest row kernel the features allow.
+inline SwizzleRow swizzleRowFor(const CpuFeatures& features) noexcept {
+#ifdef CORE_X86
+    if (features.avx512bw) {
+        return &swizzleRowAvx512;
+    }
+    if (features.avx2) {
+        return &swizzleRowAvx2;
+    }
+    if (features.ssse3) {
+        return &swizzleRowSsse3;
+    }
+#else
+    Q_UNUSED(features);
+#endif
+    return &swizzleRowScalar;
+}
+
+inline SwizzleRow swizzleRow() noexcept {
+    static const SwizzleRow kernel = swizzleRowFor(cpuFeatures());
+    return kernel;
+}
+
+inline void swizzle(const cv::Mat& src, const SwizzlePlan& plan, cv::Mat& dst,
+                    SwizzleRow kernel = swizzleRow()) {
+    dst.create(src.rows, src.cols, CV_MAKETYPE(CV_8U, plan.dstChannels));
+
+    if (src.isContinuous() && dst.isContinuous() &&
+        qint64(src.rows) * src.cols <= INT_MAX) {
+        kernel(src.data, dst.data, src.rows * src.cols, plan);
+        return;
+    }
+
+    for (int y = 0; y < src.rows; ++y) {
+        kernel(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols, plan);
+    }
+}
+
+inline void swizzle(const cv::Mat& src, Image::Format from, Image::Format to,
+                    cv::Mat& dst) {
+    swizzle(src, swizzlePlan(from, to), dst);
+}
+} // namespace image_conversion
+} // namespace core
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "image.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <QtGlobal>
+
+namespace core {
+// The lookup tables of a ToneMapping: 64K levels indexed by samples scaled
+// to 16 bits, and the 256 colors of its palette. Immutable once built, so
+// converter threads share one through ConversionOptions::toneLut; build a
+// new one when the mapping changes.
+class ToneLut {
+public:
+    using Palette = Image::ToneMapping::Palette;
+    using Curve = Image::ToneMapping::Curve;
+
+    static constexpr int entries = 1 << 16;
+
+    explicit ToneLut(const Image::ToneMapping& mapping) : m_mapping(mapping) {
+        const double low = mapping.level - mapping.window / 2;
+        const double gamma = mapping.gamma > 0 ? mapping.gamma : 1.0;
+        for (int i = 0; i < entries; ++i) {
+            const double v = double(i) / (entries - 1);
+            double x = mapping.window > 0 ? (v - low) / mapping.window
+                                          : (v < mapping.level ? 0.0 : 1.0);
+            x = std::clamp(x, 0.0, 1.0);
+            switch (mapping.curve) {
+            case Curve::linear:
+                break;
+            case Curve::gamma:
+                x = std::pow(x, 1.0 / gamma);
+                break;
+            case Curve::logarithmic:
+                x = std::log1p(1023 * x) / std::log1p(1023.0);
+                break;
+            }
+            m_levels[i] = uchar(std::lround(x * 255));
+        }
+
+        for (int i = 0; i < 256; ++i) {
+            m_palette[i] = paletteColor(mapping.palette, i / 255.0);
+        }
+    }
+
+    const Image::ToneMapping& mapping() const noexcept {
+        return m_mapping;
+    }
+
+    bool falseColor() const noexcept {
+        return m_mapping.palette != Palette::grayscale;
+    }
+
+    uchar level(int index) const noexcept {
+        return m_levels[index];
+    }
+
+    // r, g, b of a level
+    const uchar* color(uchar level) const noexcept {
+        return m_palette[level].data();
+    }
+
+private:
+    static std::array<uchar, 4> paletteColor(Palette palette, double t) {
+        const auto byte = [](double v) {
+            return uchar(std::lround(std::clamp(v, 0.0, 1.0) * 255));
+        };
+        switch (palette) {
+        case Palette::jet:
+            return {byte(1.5 - std::abs(4 * t - 3)),
+                    byte(1.5 - std::abs(4 * t - 2)),
+                    byte(1.5 - std::abs(4 * t - 1)), 255};
+        case Palette::hot:
+            return {byte(3 * t), byte(3 * t - 1), byte(3 * t - 2), 255};
+        default:
+            return {byte(t), byte(t), byte(t), 255};
+        }
+    }
+
+    Image::ToneMapping m_mapping;
+    std::array<uchar, entries> m_levels;
+    std::array<std::array<uchar, 4>, 256> m_palette;
+};
+
+namespace image_conversion {
+// Demosaic kernel mapping (see demosaic::ShiftMapping) through a ToneLut.
+// Values are rescaled from the source's full scale to the table's in Q16,
+// so every bit depth spans the whole table.
+class LutMapping {
+public:
+    LutMapping(const ToneLut& lut, int sourceBits) noexcept :
+            m_lut(&lut),
+            m_scale((quint64(ToneLut::entries - 1) << 16) /
+                    ((quint64(1) << sourceBits) - 1)) {}
+
+    LutMapping shifted(int bits) const noexcept {
+        LutMapping mapping = *this;
+        mapping.m_shift += bits;
+        return mapping;
+    }
+
+    bool falseColor() const noexcept {
+        return m_lut->falseColor();
+    }
+
+    uchar channel(quint32 v4) const noexcept {
+        return m_lut->level(index(v4, m_shift + 2));
+    }
+
+    uchar gray(quint64 y) const noexcept {
+        return m_lut->level(index(y, m_shift + 16));
+    }
+
+    const uchar* palette(quint64 y) const noexcept {
+        return m_lut->color(gray(y));
+    }
+
+private:
+    int index(quint64 v, int shift) const noexcept {
+        const int s = shift + 16;
+        const quint64 i = (v * m_scale + (quint64(1) << (s - 1))) >> s;
+        return int((std::min)(i, quint64(ToneLut::entries - 1)));
+    }
+
+    const ToneLut* m_lut;
+    quint64 m_scale;
+    int m_shift{0};
+};
+} // namespace image_conversion
+} // namespace core
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+
+#include <QtGlobal>
+
+namespace core {
+// Durations recorded over the last few seconds, for percentiles cheap enough
+// to keep on in production: recording is two relaxed atomic operations on a
+// fixed array, no allocation and no lock. Buckets are a quarter octave wide,
+// from 1 microsecond to 34 seconds; percentiles are their upper bounds, at
+// most a quarter above the true value.
+//
+// The window is made of slices, each counting its own second; a recorder
+// reaching a slice last used a window ago clears it first. One thread
+// records at a time, any thread reads; a read racing a slice being cleared
+// may miss that slice's oldest samples.
+class LatencyHistogram : NonCopyable {
+public:
+    static constexpr int bucketCount = 100;
+    static constexpr int sliceCount = 5;
+    static constexpr qint64 sliceNanoseconds = 1'000'000'000;
+
+    // The steady clock recordings are timed with, in nanoseconds.
+    static qint64 now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    void record(qint64 nanoseconds, qint64 at = now()) noexcept {
+        const qint64 epoch = at / sliceNanoseconds;
+        Slice& slice = m_slices[epoch % sliceCount];
+        if (slice.epoch.load(std::memory_order_relaxed) != epoch) {
+            for (auto& count : slice.counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            slice.epoch.store(epoch, std::memory_order_relaxed);
+        }
+        slice.counts[bucketOf(nanoseconds)].fetch_add(
+                1, std::memory_order_relaxed);
+    }
+
+    // Samples in the window ending at.
+    quint64 count(qint64 at = now()) const noexcept {
+        quint64 total = 0;
+        forEachLive(at, [&](int, quint32 n) { total += n; });
+        return total;
+    }
+
+    // The duration q of the window's samples are within, 0 <= q <= 1; 0
+    // when it holds none.
+    qint64 percentile(double q, qint64 at = now()) const noexcept {
+        std::array<quint64, bucketCount> counts{};
+        quint64 total = 0;
+        forEachLive(at, [&](int bucket, quint32 n) {
+            counts[bucket] += n;
+            total += n;
+        });
+        if (total == 0) {
+            return 0;
+        }
+        const quint64 rank = (std::max)(quint64(q * total + 0.5), quint64(1));
+        quint64 seen = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return upperBound(i);
+            }
+        }
+        return upperBound(bucketCount - 1);
+    }
+
+private:
+    struct Slice {
+        std::atomic<qint64> epoch{-1};
+        std::array<std::atomic<quint32>, bucketCount> counts{};
+    };
+
+    // Bucket 0 holds everything under 1024 ns, then four per octave.
+    static int bucketOf(qint64 nanoseconds) noexcept {
+        if (nanoseconds < 1024) {
+            return 0;
+        }
+        const int msb = std::bit_width(quint64(nanoseconds)) - 1;
+        const int quarter = int(nanoseconds >> (msb - 2)) & 3;
+        return (std::min)((msb - 10) * 4 + quarter + 1, bucketCount - 1);
+    }
+
+    static qint64 upperBound(int bucket) noexcept {
+        if (bucket == 0) {
+            return 1024;
+        }
+        const int msb = (bucket - 1) / 4 + 10;
+        const int quarter = (bucket - 1) % 4;
+        return (qint64(4 + quarter + 1) << (msb - 2));
+    }
+
+    template <class F>
+    void forEachLive(qint64 at, F&& f) const {
+        const qint64 epoch = at / sliceNanoseconds;
+        for (const auto& slice : m_slices) {
+            const qint64 e = slice.epoch.load(std::memory_order_relaxed);
+            if (e > epoch - sliceCount && e <= epoch) {
+                for (int i = 0; i < bucketCount; ++i) {
+                    f(i, slice.counts[i].load(std::memory_order_relaxed));
+                }
+            }
+        }
+    }
+
+    std::array<Slice, sliceCount> m_slices;
+};
+} // namespace core
@@ -1,10 +1,12 @@
 #include "mainwindow.h"
+#include "trace.hpp"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    CORE_TRACE_TO_FILE("trace.json");
     MainWindow w;
     w.show();
     return a.exec();
@@ -0,0 +1,314 @@
+#pragma once
+
+// Tracing for the frame paths: which thread converted, delivered and painted
+// what, and for how long, without the cost of qDebug() where it matters.
+//
+//     CORE_TRACE("ImageItem::setFrame", width, height);
+//     CORE_TRACE_SCOPE("Image::convertInto", int(format()));
+//
+// Names must be string literals; up to two integer arguments are kept with
+// each event. Unless CORE_TRACING is defined the macros expand to nothing
+// and their arguments are not evaluated. With it, each thread appends
+// fixed-size events to a ring of its own, without locks or allocation after
+// its first event, and CORE_TRACE_TO_FILE in main() starts a thread that
+// drains the rings into a chrome://tracing file. A thread whose ring is full
+// drops its events and counts them.
+
+#ifdef CORE_TRACING
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+namespace trace {
+enum class Phase : quint8 { instant, begin, end };
+
+struct Event {
+    qint64 nanoseconds{0};
+    const char* name{nullptr};
+    qint64 args[2]{};
+    quint32 thread{0};
+    Phase phase{Phase::instant};
+};
+
+// One thread's events. The owning thread pushes, the drainer pops; each
+// only writes its own index.
+class Ring {
+public:
+    static constexpr std::size_t capacity = 8192;
+
+    explicit Ring(quint32 thread) noexcept : m_thread(thread) {}
+
+    quint32 thread() const noexcept {
+        return m_thread;
+    }
+
+    void push(const Event& event) noexcept {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == capacity) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_events[head % capacity] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    template <class F>
+    void drain(F&& f) {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        const std::size_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            f(m_events[tail % capacity]);
+        }
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    bool isEmpty() const noexcept {
+        return m_head.load(std::memory_order_acquire) ==
+               m_tail.load(std::memory_order_relaxed);
+    }
+
+    quint64 dropped() const noexcept {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    // Set when the owning thread exits; the drainer then forgets the ring
+    // once it is empty.
+    std::atomic<bool> exited{false};
+
+private:
+    std::array<Event, capacity> m_events;
+    alignas(64) std::atomic<std::size_t> m_head{0};
+    alignas(64) std::atomic<std::size_t> m_tail{0};
+    std::atomic<quint64> m_dropped{0};
+    const quint32 m_thread;
+};
+
+namespace detail {
+using Clock = std::chrono::steady_clock;
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    quint32 nextThread{1};
+    // of rings already forgotten
+    quint64 dropped{0};
+    const Clock::time_point started{Clock::now()};
+};
+
+// Intentionally leaked, threads may still trace during static destruction.
+inline Registry& registry() {
+    static Registry* r = new Registry();
+    return *r;
+}
+
+struct ThreadRing {
+    std::shared_ptr<Ring> ring;
+
+    ThreadRing() {
+        Registry& r = registry();
+        std::lock_guard lock(r.mutex);
+        ring = std::make_shared<Ring>(r.nextThread++);
+        r.rings.push_back(ring);
+    }
+
+    ~ThreadRing() {
+        ring->exited.store(true, std::memory_order_release);
+    }
+};
+
+inline Ring& threadRing() {
+    thread_local ThreadRing local;
+    return *local.ring;
+}
+
+inline void record(Phase phase, const char* name, qint64 a,
+                   qint64 b) noexcept {
+    Ring& ring = threadRing();
+    Event event;
+    event.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                Clock::now() - registry().started)
+                                .count();
+    event.name = name;
+    event.args[0] = a;
+    event.args[1] = b;
+    event.thread = ring.thread();
+    event.phase = phase;
+    ring.push(event);
+}
+} // namespace detail
+
+template <std::size_t N>
+inline void instant(const char (&name)[N], qint64 a = 0,
+                    qint64 b = 0) noexcept {
+    detail::record(Phase::instant, name, a, b);
+}
+
+// Begin and end events around its lifetime.
+class Scope {
+public:
+    template <std::size_t N>
+    explicit Scope(const char (&name)[N], qint64 a = 0,
+                   qint64 b = 0) noexcept : m_name(name) {
+        detail::record(Phase::begin, name, a, b);
+    }
+
+    ~Scope() {
+        detail::record(Phase::end, m_name, 0, 0);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* m_name;
+};
+
+// Takes every thread's events recorded since the last call, ordered by
+// time; returns the events dropped since then through dropped.
+inline std::vector<Event> drain(quint64* dropped = nullptr) {
+    detail::Registry& r = detail::registry();
+    std::vector<Event> events;
+    std::lock_guard lock(r.mutex);
+    quint64 total = r.dropped;
+    for (auto it = r.rings.begin(); it != r.rings.end();) {
+        Ring& ring = **it;
+        const bool exited = ring.exited.load(std::memory_order_acquire);
+        ring.drain([&](const Event& e) { events.push_back(e); });
+        total += ring.dropped();
+        if (exited && ring.isEmpty()) {
+            r.dropped += ring.dropped();
+            it = r.rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    static quint64 reported = 0;
+    if (dropped) {
+        *dropped = total - reported;
+    }
+    reported = total;
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event& a, const Event& b) {
+                         return a.nanoseconds < b.nanoseconds;
+                     });
+    return events;
+}
+
+// Drains every intervalMilliseconds into path, in the Trace Event Format
+// chrome://tracing and Perfetto open, until destroyed.
+class FileWriter {
+public:
+    explicit FileWriter(const QString& path, int intervalMilliseconds = 100) :
+            m_file(path) {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return;
+        }
+        m_file.write("[\n");
+        m_thread = std::thread([this, intervalMilliseconds] {
+            std::unique_lock lock(m_mutex);
+            while (!m_wake.wait_for(
+                    lock, std::chrono::milliseconds(intervalMilliseconds),
+                    [this] { return m_stopping; })) {
+                write();
+            }
+        });
+    }
+
+    ~FileWriter() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+        write();
+        m_file.write("\n]\n");
+    }
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+private:
+    void write() {
+        quint64 dropped = 0;
+        const auto events = drain(&dropped);
+        QByteArray out;
+        for (const Event& e : events) {
+            static constexpr char phases[] = {'i', 'B', 'E'};
+            // instants are drawn on their thread's track
+            const char* scope = e.phase == Phase::instant ? ",\"s\":\"t\"" : "";
+            out += m_first ? "" : ",\n";
+            m_first = false;
+            out += QStringLiteral("{\"name\":\"%1\",\"ph\":\"%2\",\"ts\":%3,"
+                                  "\"pid\":1,\"tid\":%4%5")
+                           .arg(QLatin1String(e.name))
+                           .arg(QLatin1Char(phases[int(e.phase)]))
+                           .arg(e.nanoseconds / 1e3, 0, 'f', 3)
+                           .arg(e.thread)
+                           .arg(QLatin1String(scope))
+                           .toLatin1();
+            if (e.phase != Phase::end) {
+                out += QStringLiteral(",\"args\":{\"a\":%1,\"b\":%2}")
+                               .arg(e.args[0])
+                               .arg(e.args[1])
+                               .toLatin1();
+            }
+            out += '}';
+        }
+        if (dropped) {
+            out += m_first ? "" : ",\n";
+            m_first = false;
+            out += QStringLiteral("{\"name\":\"trace dropped\",\"ph\":\"i\","
+                                  "\"s\":\"g\",\"ts\":%1,\"pid\":1,\"tid\":0,"
+                                  "\"args\":{\"events\":%2}}")
+                           .arg(events.empty() ? 0.0
+                                               : events.back().nanoseconds /
+                                                         1e3,
+                                0, 'f', 3)
+                           .arg(dropped)
+                           .toLatin1();
+        }
+        m_file.write(out);
+        m_file.flush();
+    }
+
+    QFile m_file;
+    bool m_first{true};
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping{false};
+};
+} // namespace trace
+} // namespace core
+
+#define CORE_TRACE_CONCAT_X(x, y) x##y
+#define CORE_TRACE_CONCAT(x, y) CORE_TRACE_CONCAT_X(x, y)
+
+#define CORE_TRACE(...) core::trace::instant(__VA_ARGS__)
+#define CORE_TRACE_SCOPE(...) \
+    const core::trace::Scope CORE_TRACE_CONCAT(coreTraceScope_, __LINE__)( \
+            __VA_ARGS__)
+#define CORE_TRACE_TO_FILE(path) \
+    const core::trace::FileWriter coreTraceFileWriter(path)
+#else
+#define CORE_TRACE(...) static_cast<void>(0)
+#define CORE_TRACE_SCOPE(...) static_cast<void>(0)
+#define CORE_TRACE_TO_FILE(path) static_cast<void>(0)
+#endif
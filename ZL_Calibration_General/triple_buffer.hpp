@@ -0,0 +1,72 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <atomic>
+#include <utility>
+
+#include <QtGlobal>
+
+namespace core {
+// Hands the newest value from one producer thread to one consumer thread
+// without locks. Three slots: the producer fills its own and swaps it with
+// the shared middle one, the consumer swaps the middle one with its own when
+// it holds something new. Neither ever waits; a value the consumer has not
+// taken when the next one is published is dropped and counted.
+template <class T>
+class TripleBuffer : NonCopyable {
+public:
+    // Producer side. Returns false when value replaced one the consumer had
+    // not taken yet, true when the middle slot was empty, in which case the
+    // consumer may need waking.
+    bool publish(T value) {
+        m_slots[m_back] = std::move(value);
+        const quint8 previous = m_middle.exchange(quint8(m_back | fresh),
+                                                  std::memory_order_acq_rel);
+        m_back = previous & index;
+        if (previous & fresh) {
+            // release the dropped value now rather than on the next publish
+            m_slots[m_back] = T();
+            m_skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Consumer side. Moves the newest value into out; false when nothing new
+    // was published since the last take.
+    bool take(T& out) {
+        if (!hasNew()) {
+            return false;
+        }
+        const quint8 previous =
+                m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & index;
+        out = std::move(m_slots[m_front]);
+        m_slots[m_front] = T();
+        return true;
+    }
+
+    bool hasNew() const noexcept {
+        return m_middle.load(std::memory_order_acquire) & fresh;
+    }
+
+    // Values dropped for a newer one since construction, from any thread.
+    quint64 skipped() const noexcept {
+        return m_skipped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr quint8 index = 0x3;
+    static constexpr quint8 fresh = 0x4;
+
+    T m_slots[3];
+    // producer only
+    quint8 m_back = 0;
+    // slot index, with fresh set while the consumer has not taken it
+    std::atomic<quint8> m_middle{1};
+    // consumer only
+    quint8 m_front = 2;
+    std::atomic<quint64> m_skipped{0};
+};
+} // namespace core